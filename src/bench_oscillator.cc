@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "instrument.h"
+
+using namespace std;
+
+typedef ToneGeneratorInstrument<int, long long> ToneGenerator;
+
+const int kSampleRate = 22000;
+
+// Voices mixed into each chunk of the renderer, and chunks mixed per
+// oscillator.
+const int kChunkSampleSize = 22000;
+const int kVoiceCount = 16;
+const int kChunkCount = 200;
+
+// Time mixing the voices of long notes chunk after chunk into 'accumulator'
+// with 'oscillator'. Returns nanoseconds per voice sample.
+double TimeOscillator(ToneGenerator::Oscillator oscillator,
+                      vector<long long>* accumulator) {
+  ToneGenerator instrument(oscillator);
+  VoiceBatch voices;
+  voices.Reserve(kVoiceCount);
+  int64_t start = CallbackProfiler::Now();
+  for (int chunk = 0; chunk < kChunkCount; ++chunk) {
+    voices.Clear();
+    for (int voice = 0; voice < kVoiceCount; ++voice) {
+      voices.Add(110.0f * (voice + 1), 1.0f / kVoiceCount,
+                 kChunkCount * kChunkSampleSize, chunk * kChunkSampleSize, 0,
+                 kChunkSampleSize);
+    }
+    instrument.MixVoices(voices, kSampleRate, &(*accumulator)[0]);
+  }
+  return static_cast<double>(CallbackProfiler::Now() - start) /
+         (static_cast<double>(kChunkCount) * kVoiceCount * kChunkSampleSize);
+}
+
+// Times the PHASOR oscillator of the tone generator against the REFERENCE
+// one, mixing voices of notes spanning all the chunks. See instrument_test for
+// their agreement.
+int main() {
+  vector<long long> accumulator(kChunkSampleSize);
+  double reference = TimeOscillator(ToneGenerator::REFERENCE, &accumulator);
+  double phasor = TimeOscillator(ToneGenerator::PHASOR, &accumulator);
+  printf("%d chunks of %d samples of %d voices.\n", kChunkCount,
+         kChunkSampleSize, kVoiceCount);
+  printf("%10s %10s %12s\n", "oscillator", "ns/sample", "Msamples/s");
+  printf("%10s %10.2f %12.1f\n", "reference", reference, 1e3 / reference);
+  printf("%10s %10.2f %12.1f\n", "phasor", phasor, 1e3 / phasor);
+  printf("%.1fx faster.\n", reference / phasor);
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "parser.h"
+#include "segment.h"
+
+using namespace std;
+
+// Parses of the score by each thread, per thread count.
+const int kParseCount = 8;
+
+// Riffs of the generated score, of this many notes each.
+const int kRiffCount = 4000;
+const int kRiffNoteCount = 16;
+
+// The parses of the score by one thread.
+struct ParseJob {
+  const string* text;
+  string error;
+};
+
+// Parse the score of a ParseJob kParseCount times, or until an error.
+void* ParseWorker(void* parse_job) {
+  ParseJob* job = static_cast<ParseJob*>(parse_job);
+  for (int parse = 0; parse < kParseCount; ++parse) {
+    Segment<SampleType> score;
+    if (!ParseScore(*job->text, &score, &job->error)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+// A score of riffs unioned in pairs, with a named segment repeated between
+// them.
+string MakeScore() {
+  ostringstream score;
+  score << "$motif = (440@0.5x0.25 550@0.5x0.25) & (220@0.25x0.5);\n";
+  for (int riff = 0; riff < kRiffCount; ++riff) {
+    score << "(";
+    for (int note = 0; note < kRiffNoteCount; ++note) {
+      score << " " << 110 + (riff * 7 + note * 5) % 880 << "@0.1x0.125";
+    }
+    score << ")" << (riff % 2 == 0 ? " &\n" : "\n");
+    if (riff % 100 == 99) {
+      score << "$motif x 4\n";
+    }
+  }
+  return score.str();
+}
+
+// Read the whole file at 'path' into 'text'.
+bool ReadFile(const char* path, string* text) {
+  int file = open(path, O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+  char buffer[65536];
+  ssize_t size;
+  while ((size = read(file, buffer, sizeof(buffer))) > 0) {
+    text->append(buffer, size);
+  }
+  close(file);
+  return size == 0;
+}
+
+// Times parsing the same score from 1 to 'max_threads' threads at once, by
+// default as many as there are processors, and prints the throughput and its
+// scaling over a single thread. The score is generated unless a .mae file is
+// given.
+int main(int argc, char** argv) {
+  int max_thread_count = argc > 1 ? atoi(argv[1])
+                                  : int(sysconf(_SC_NPROCESSORS_ONLN));
+  string text;
+  if (argc > 3 || max_thread_count < 1 ||
+      (argc == 3 && !ReadFile(argv[2], &text))) {
+    fprintf(stderr, "Usage: %s [max_threads [score.mae]]\n", argv[0]);
+    return 1;
+  }
+  if (argc < 3) {
+    text = MakeScore();
+  }
+  printf("Score of %.1f kB, parsed %d times per thread.\n",
+         text.size() / 1024.0, kParseCount);
+  printf("%7s %10s %10s %9s %10s\n", "threads", "seconds", "MB/s",
+         "speedup", "efficiency");
+
+  double single_thread_rate = 0.0;
+  // Thread counts double up to the maximum.
+  for (int thread_count = 1; ;
+       thread_count = min(2 * thread_count, max_thread_count)) {
+    vector<ParseJob> jobs(thread_count);
+    vector<pthread_t> threads(thread_count);
+    int64_t start = CallbackProfiler::Now();
+    for (int thread = 0; thread < thread_count; ++thread) {
+      jobs[thread].text = &text;
+      if (pthread_create(&threads[thread], NULL, ParseWorker,
+                         &jobs[thread]) != 0) {
+        fprintf(stderr, "Cannot start the parser threads.\n");
+        return 1;
+      }
+    }
+    for (int thread = 0; thread < thread_count; ++thread) {
+      pthread_join(threads[thread], NULL);
+      if (!jobs[thread].error.empty()) {
+        fprintf(stderr, "%s\n", jobs[thread].error.c_str());
+        return 1;
+      }
+    }
+    double seconds = 1e-9 * (CallbackProfiler::Now() - start);
+
+    double bytes = static_cast<double>(text.size()) * kParseCount *
+                   thread_count;
+    double rate = bytes / seconds;
+    if (thread_count == 1) {
+      single_thread_rate = rate;
+    }
+    double speedup = rate / single_thread_rate;
+    printf("%7d %10.3f %10.1f %8.2fx %9.1f%%\n", thread_count, seconds,
+           rate / 1e6, speedup, 100.0 * speedup / thread_count);
+    if (thread_count == max_thread_count) {
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "callback_profiler.h"
+#include "parser.h"
+#include "segment.h"
+
+using namespace std;
+
+// Lines of the generated score, each a riff of this many notes.
+const int kLineCount = 20000;
+const int kLineNoteCount = 12;
+
+const int kSampleRate = 22000;
+
+// Allocations made through operator new while 'counting' is set. The bench is
+// single threaded.
+bool counting = false;
+int64_t allocation_count = 0;
+int64_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+  if (counting) {
+    ++allocation_count;
+    allocated_bytes += size;
+  }
+  void* memory = malloc(size > 0 ? size : 1);
+  if (memory == NULL) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+// Not inlined, so that the compiler does not mistake the free() of memory from
+// operator new for a mismatched deallocation.
+__attribute__((noinline)) void operator delete(void* memory) {
+  free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t size) {
+  free(memory);
+}
+
+// A score of commented riffs, unioned in pairs, with a named motif repeated
+// between them.
+string MakeScore() {
+  ostringstream score;
+  score << "/* Motif. */ $motif = (440@0.5x0.25 550@0.5x0.25) & "
+        << "(220@0.25x0.5);\n";
+  for (int line = 0; line < kLineCount; ++line) {
+    score << "/* Line " << line << ". */ (";
+    for (int note = 0; note < kLineNoteCount; ++note) {
+      score << " " << 110 + (line * 7 + note * 5) % 880 << "@0.1x0.125";
+    }
+    score << ")" << (line % 2 == 0 ? " &\n" : "\n");
+    if (line % 100 == 99) {
+      score << "$motif x 4\n";
+    }
+  }
+  return score.str();
+}
+
+// Allocations counted over a stage of the bench.
+struct StageCount {
+  int64_t allocation_count;
+  int64_t allocated_bytes;
+  int64_t nanoseconds;
+};
+
+// Count the allocations from now on. Returns the time counting started.
+int64_t StartCounting() {
+  allocation_count = 0;
+  allocated_bytes = 0;
+  counting = true;
+  return CallbackProfiler::Now();
+}
+
+// Stop counting the allocations since 'start'.
+StageCount StopCounting(int64_t start) {
+  counting = false;
+  StageCount count = { allocation_count, allocated_bytes,
+                       CallbackProfiler::Now() - start };
+  return count;
+}
+
+void PrintStage(const char* stage, const StageCount& count,
+                int64_t note_count) {
+  printf("%-8s %12lld %10.1f %10.2f %10.1f %9.3f\n", stage,
+         (long long)count.allocation_count, count.allocated_bytes / 1e6,
+         static_cast<double>(count.allocation_count) / note_count,
+         static_cast<double>(count.allocated_bytes) / note_count,
+         1e-9 * count.nanoseconds);
+}
+
+// Counts the heap allocations made by parsing a generated score, by flattening
+// it into notes and by releasing it, per note of the score. Parser values are
+// kept in per-parse storage, so parsing allocates about one segment node per
+// note and operator.
+int main() {
+  string text = MakeScore();
+  printf("Score of %d lines of %d notes, %.1f MB.\n", kLineCount,
+         kLineNoteCount, text.size() / 1e6);
+
+  Segment<SampleType>* score = new Segment<SampleType>();
+  string error;
+  int64_t start = StartCounting();
+  bool parsed = ParseScore(text, score, &error);
+  StageCount parse = StopCounting(start);
+  if (!parsed) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  start = StartCounting();
+  int64_t note_count = score->notes(kSampleRate).size();
+  StageCount flatten = StopCounting(start);
+
+  start = StartCounting();
+  delete score;
+  StageCount release = StopCounting(start);
+
+  printf("%lld notes.\n", (long long)note_count);
+  printf("%-8s %12s %10s %10s %10s %9s\n", "stage", "allocations", "MB",
+         "per note", "B/note", "seconds");
+  PrintStage("parse", parse, note_count);
+  PrintStage("flatten", flatten, note_count);
+  PrintStage("release", release, note_count);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "pitch_shifter.h"
+
+using namespace std;
+
+const int kSampleRate = 48000;
+
+// Window sizes timed, each overlapping 4 times as in the pitch modulator.
+const size_t kWindowSizes[] = { 512, 1024, 2048, 4096 };
+const size_t kOverlap = 4;
+
+// Samples handed to the shifter at once, as a JACK period.
+const size_t kBlockSize = 256;
+
+// Seconds of signal shifted per window size, by default.
+const double kDefaultSeconds = 10.0;
+
+// Shift 'input' through a shifter of 'window_size' with 'voice_count' voices,
+// the first a fifth up and each next one a third above, and print the
+// throughput against real time.
+template <typename Real>
+void BenchShift(const char* type_name,
+                size_t window_size,
+                size_t voice_count,
+                const vector<Real>& input) {
+  PitchShifter<Real> shifter(window_size, window_size / kOverlap,
+                             voice_count);
+  shifter.set_voice_count(voice_count);
+  for (size_t voice = 0; voice < voice_count; ++voice) {
+    shifter.set_pitch_ratio(voice, pow(2.0, (7.0 + 4.0 * voice) / 12.0));
+  }
+  vector<Real> output(kBlockSize);
+  int64_t start = CallbackProfiler::Now();
+  size_t done = 0;
+  for (; done + kBlockSize <= input.size(); done += kBlockSize) {
+    shifter.Process(&input[done], kBlockSize, &output[0]);
+  }
+  double seconds = 1e-9 * (CallbackProfiler::Now() - start);
+  double frame_count = static_cast<double>(done) * kOverlap / window_size;
+  printf("%6s %7d %6d %12.2f %11.1f %10.1fx\n", type_name, int(window_size),
+         int(voice_count), done / seconds / 1e6, 1e6 * seconds / frame_count,
+         done / seconds / kSampleRate);
+}
+
+template <typename Real>
+void BenchShifts(const char* type_name, double signal_seconds) {
+  vector<Real> input(static_cast<size_t>(signal_seconds * kSampleRate));
+  for (size_t sample = 0; sample < input.size(); ++sample) {
+    input[sample] = 0.5 * sin(2.0 * M_PI * 220.0 * sample / kSampleRate);
+  }
+  size_t size_count = sizeof(kWindowSizes) / sizeof(kWindowSizes[0]);
+  for (size_t voice_count = 1; voice_count <= 3; voice_count += 2) {
+    for (size_t size = 0; size < size_count; ++size) {
+      BenchShift(type_name, kWindowSizes[size], voice_count, input);
+    }
+  }
+}
+
+// Times PitchShifter::Process() at window sizes from 512 to 4096 samples, with
+// a single voice and with a harmony of three, in single and double precision.
+int main(int argc, char** argv) {
+  double signal_seconds = argc > 1 ? atof(argv[1]) : kDefaultSeconds;
+  if (argc > 2 || signal_seconds <= 0.0) {
+    fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+    return 1;
+  }
+  printf("%.1f s of signal at %d Hz per window size, in blocks of %d "
+         "samples, hops of\n1/%d window.\n", signal_seconds, kSampleRate,
+         int(kBlockSize), int(kOverlap));
+  printf("%6s %7s %6s %12s %11s %11s\n", "type", "window", "voices",
+         "Msamples/s", "us/frame", "realtime");
+  BenchShifts<float>("float", signal_seconds);
+  BenchShifts<double>("double", signal_seconds);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "fft.h"
+#include "pitch_modulator.h"
+#include "pitch_tracker.h"
+
+using namespace std;
+
+const int kSampleRate = 48000;
+
+// Window sizes timed, around the default of the pitch modulator.
+const size_t kWindowSizes[] = { 512, 1024, 2048, 4096 };
+
+// Pitches tracked, as by the pitch modulator.
+const size_t kMaxPitches = 4;
+
+// Frames tracked per window size.
+const size_t kFrameCount = 4096;
+
+// Frames of the spectrogram tracked in turn, a voice gliding up a semitone.
+const size_t kSpectrumCount = 16;
+
+// Fill 'samples' with a voice of a few harmonics, gliding from 'frequency'.
+void FillVoice(double frequency, vector<float>* samples) {
+  double phase = 0.0;
+  for (size_t sample = 0; sample < samples->size(); ++sample) {
+    double value = 0.0;
+    for (int harmonic = 1; harmonic <= 4; ++harmonic) {
+      value += sin(harmonic * phase) / harmonic;
+    }
+    (*samples)[sample] = 0.25 * value;
+    phase += 2.0 * M_PI * frequency *
+        pow(2.0, static_cast<double>(sample) / samples->size() / 12.0) /
+        kSampleRate;
+  }
+}
+
+// Time PitchTracker::Track() over the frames of a window of 'window_size',
+// and print the time taken per frame against the hop of the pitch modulator.
+template <typename Real>
+void BenchTrack(const char* type_name, size_t window_size) {
+  size_t hop_size = window_size / PitchModulator<Real>::kDefaultOverlap;
+  vector<float> voice(window_size + (kSpectrumCount - 1) * hop_size);
+  FillVoice(220.0, &voice);
+  vector<Real> window(window_size);
+  for (size_t sample = 0; sample < window_size; ++sample) {
+    window[sample] = 0.5 - 0.5 * cos(2.0 * M_PI * sample / window_size);
+  }
+  typename FFT<Real>::Spectrogram spectrogram;
+  FFT<Real>::ComputeSpectrogram(&voice[0], voice.size(), &window[0],
+                                window_size, hop_size, 1, &spectrogram);
+
+  PitchTracker<Real> tracker(window_size, kSampleRate, kMaxPitches);
+  size_t pitch_count = 0;
+  int64_t start = CallbackProfiler::Now();
+  for (size_t frame_index = 0; frame_index < kFrameCount; ++frame_index) {
+    pitch_count +=
+        tracker.Track(spectrogram.spectrum(frame_index % kSpectrumCount));
+  }
+  double frame_nanoseconds =
+      static_cast<double>(CallbackProfiler::Now() - start) / kFrameCount;
+
+  double hop_nanoseconds = 1e9 * hop_size / kSampleRate;
+  printf("%6s %7d %12.1f %11.3f%% %9.2f %10.1f\n", type_name,
+         int(window_size), frame_nanoseconds / 1000.0,
+         100.0 * frame_nanoseconds / hop_nanoseconds,
+         static_cast<double>(pitch_count) / kFrameCount,
+         tracker.pitches().empty() ? 0.0 : tracker.pitches()[0].frequency);
+}
+
+// Times PitchTracker::Track() at the window sizes of the pitch modulator, on
+// precomputed spectra, so that the transforms are not timed.
+int main() {
+  printf("%d frames per window size at %d Hz, up to %d pitches, hops of "
+         "1/%d window.\n", int(kFrameCount), kSampleRate, int(kMaxPitches),
+         int(PitchModulator<float>::kDefaultOverlap));
+  printf("%6s %7s %12s %12s %9s %10s\n", "type", "window", "us/frame",
+         "hop share", "pitches", "last Hz");
+  size_t size_count = sizeof(kWindowSizes) / sizeof(kWindowSizes[0]);
+  for (size_t size = 0; size < size_count; ++size) {
+    BenchTrack<float>("float", kWindowSizes[size]);
+  }
+  for (size_t size = 0; size < size_count; ++size) {
+    BenchTrack<double>("double", kWindowSizes[size]);
+  }
+  return 0;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+
+#include "callback_profiler.h"
+#include "note.h"
+#include "render_sink.h"
+#include "renderer.h"
+#include "segment.h"
+
+using namespace std;
+
+typedef int SampleType;
+typedef long long AccumulatorType;
+typedef Renderer<SampleType, AccumulatorType> ScoreRenderer;
+
+// Voices of the score, each playing a note per step.
+const int kVoiceCount = 16;
+const int kStepCount = 2400;
+const float kStepSeconds = 0.125f;
+
+// Renders timed per thread count, of which the fastest is kept.
+const int kRepetitionCount = 3;
+
+// Note counts of the scores rendered on a single thread by the note count
+// sweep.
+const int kSweepNoteCounts[] = { 1000, 3000, 10000, 30000, 100000 };
+
+// Dense scores of the sweep have lines of this many long notes, all sounding
+// at once, so that the number of overlapping notes grows with the note count.
+const int kDenseLineNoteCount = 50;
+const float kDenseNoteSeconds = 1.0f;
+
+// Sparse scores of the sweep have this many lines of short notes, so that
+// their length grows with the note count instead.
+const int kSparseLineCount = 8;
+
+// Counts and discards the rendered samples.
+class NullSink : public RenderSink<SampleType> {
+ public:
+  NullSink() : sample_count_(0) {}
+  virtual ~NullSink() {}
+
+  virtual bool Open(int sample_rate) {
+    sample_count_ = 0;
+    return true;
+  }
+  virtual bool Write(const SampleType* samples, size_t sample_count) {
+    sample_count_ += sample_count;
+    return true;
+  }
+  virtual bool Close() { return true; }
+
+  int64_t sample_count() const { return sample_count_; }
+
+ private:
+  int64_t sample_count_;
+};
+
+// A score of 'line_count' lines of 'step_count' notes of 'step_seconds',
+// without instances, so that every chunk is synthesized note by note. The
+// lines share the amplitude of a note, and the first note of each line is
+// shortened by up to a step, so that the lines do not all change notes at
+// once.
+Segment<SampleType> MakeScore(int line_count, int step_count,
+                              float step_seconds) {
+  Segment<SampleType> score;
+  for (int voice = 0; voice < line_count; ++voice) {
+    Segment<SampleType> line;
+    for (int step = 0; step < step_count; ++step) {
+      int semitone = (voice * 7 + step * 5) % 36;
+      float frequency = 110.0f * pow(2.0f, semitone / 12.0f);
+      float seconds = step > 0 ? step_seconds
+                               : step_seconds * (16 - voice % 16) / 16.0f;
+      Note note(0.1f / line_count, frequency, seconds);
+      line.Concatenate(Segment<SampleType>(note));
+    }
+    score.Union(line);
+  }
+  return score;
+}
+
+// Time the preparation and the single threaded rendering of a score of
+// 'line_count' lines of 'step_count' notes of 'step_seconds', and print them
+// per note. Returns the rendering microseconds per note, or a negative number
+// if the rendering fails.
+double TimeNoteCount(const char* shape, int line_count, int step_count,
+                     float step_seconds) {
+  Segment<SampleType> score = MakeScore(line_count, step_count, step_seconds);
+  ScoreRenderer renderer(1);
+  ScoreRenderer::PreparedSegment prepared;
+  int64_t start = CallbackProfiler::Now();
+  renderer.Prepare(score, &prepared);
+  double prepare_seconds = 1e-9 * (CallbackProfiler::Now() - start);
+  NullSink sink;
+  start = CallbackProfiler::Now();
+  if (!renderer.Render(prepared, &sink) ||
+      sink.sample_count() < prepared.length_samples) {
+    return -1.0;
+  }
+  double render_seconds = 1e-9 * (CallbackProfiler::Now() - start);
+  double note_count = static_cast<double>(prepared.notes.size());
+  printf("%6s %7d %8d %8.1f %11.2f %10.2f %9.3f\n", shape, int(note_count),
+         line_count, static_cast<double>(prepared.length_samples) /
+         renderer.sample_rate(), 1e6 * prepare_seconds / note_count,
+         1e6 * render_seconds / note_count, prepare_seconds + render_seconds);
+  return 1e6 * render_seconds / note_count;
+}
+
+// Times scores of growing note count on a single thread, dense ones whose
+// notes overlap more and more and sparse ones which grow longer, and prints
+// the growth of the rendering time per note, which stays flat if scheduling
+// the notes scales linearly.
+bool SweepNoteCounts() {
+  printf("%6s %7s %8s %8s %11s %10s %9s\n", "score", "notes", "overlap",
+         "audio s", "prepare us", "render us", "seconds");
+  size_t sweep_count = sizeof(kSweepNoteCounts) / sizeof(kSweepNoteCounts[0]);
+  for (int dense = 1; dense >= 0; --dense) {
+    double first_note_time = 0.0;
+    double note_time = 0.0;
+    for (size_t sweep = 0; sweep < sweep_count; ++sweep) {
+      int note_count = kSweepNoteCounts[sweep];
+      note_time =
+          dense ? TimeNoteCount("dense", note_count / kDenseLineNoteCount,
+                                kDenseLineNoteCount, kDenseNoteSeconds)
+                : TimeNoteCount("sparse", kSparseLineCount,
+                                note_count / kSparseLineCount, kStepSeconds);
+      if (note_time < 0.0) {
+        fprintf(stderr, "Rendering %d notes failed.\n", note_count);
+        return false;
+      }
+      if (sweep == 0) {
+        first_note_time = note_time;
+      }
+    }
+    printf("Rendering time per %s note from %d to %d notes: %.2fx.\n",
+           dense ? "dense" : "sparse", kSweepNoteCounts[0],
+           kSweepNoteCounts[sweep_count - 1], note_time / first_note_time);
+  }
+  return true;
+}
+
+// Times the rendering of a prepared score by 1 to 'max_thread_count' worker
+// threads, by default as many as there are processors, and prints the speedup
+// over a single thread. Then sweeps the note count of scores rendered on a
+// single thread, and prints the time per note.
+int main(int argc, char** argv) {
+  int max_thread_count = argc > 1 ? atoi(argv[1])
+                                  : int(sysconf(_SC_NPROCESSORS_ONLN));
+  if (argc > 2 || max_thread_count < 1) {
+    fprintf(stderr, "Usage: %s [max_threads]\n", argv[0]);
+    return 1;
+  }
+
+  ScoreRenderer::PreparedSegment prepared;
+  ScoreRenderer(1).Prepare(MakeScore(kVoiceCount, kStepCount, kStepSeconds),
+                           &prepared);
+  double score_seconds = static_cast<double>(prepared.length_samples) /
+                         ScoreRenderer(1).sample_rate();
+  printf("%d notes, %.1f s of audio, best of %d renders.\n",
+         int(prepared.notes.size()), score_seconds, kRepetitionCount);
+  printf("%7s %10s %9s %10s %9s\n", "threads", "seconds", "speedup",
+         "efficiency", "realtime");
+
+  double single_thread_seconds = 0.0;
+  // Thread counts double up to the maximum.
+  for (int thread_count = 1; ;
+       thread_count = min(2 * thread_count, max_thread_count)) {
+    ScoreRenderer renderer(thread_count);
+    double seconds = 0.0;
+    for (int repetition = 0; repetition < kRepetitionCount; ++repetition) {
+      NullSink sink;
+      int64_t start = CallbackProfiler::Now();
+      if (!renderer.Render(prepared, &sink) ||
+          sink.sample_count() < prepared.length_samples) {
+        fprintf(stderr, "Rendering with %d threads failed.\n", thread_count);
+        return 1;
+      }
+      double elapsed = 1e-9 * (CallbackProfiler::Now() - start);
+      seconds = repetition == 0 ? elapsed : min(seconds, elapsed);
+    }
+    if (thread_count == 1) {
+      single_thread_seconds = seconds;
+    }
+    double speedup = single_thread_seconds / seconds;
+    printf("%7d %10.3f %8.2fx %9.1f%% %8.1fx\n", thread_count, seconds,
+           speedup, 100.0 * speedup / thread_count, score_seconds / seconds);
+    if (thread_count == max_thread_count) {
+      break;
+    }
+  }
+  printf("\n");
+  return SweepNoteCounts() ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+#include "callback_profiler.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Buckets of the histograms, 8 per octave from 100 ns, so that percentiles are
+// within 9% of the times. Longer times fall in the last bucket, at 1.7 s.
+const int kBucketsPerOctave = 8;
+const size_t kBucketCount = 24 * kBucketsPerOctave;
+const double kFirstBucketNanoseconds = 100.0;
+
+// How often the collector thread drains the ring.
+const useconds_t kCollectPeriodMicroseconds = 100000;
+
+// Clock reads timed to measure the cost of one.
+const int kClockCalibrationReads = 1000;
+
+const char* kStageNames[CallbackProfiler::STAGE_COUNT] = {
+  "midi", "fft", "pitch detection", "shift", "inverse fft", "synthesis",
+  "callback",
+};
+
+// The histogram bucket of a time.
+size_t BucketOf(int64_t nanoseconds) {
+  if (nanoseconds < kFirstBucketNanoseconds) {
+    return 0;
+  }
+  double bucket = floor(kBucketsPerOctave *
+                        log2(nanoseconds / kFirstBucketNanoseconds));
+  return min(static_cast<size_t>(bucket), kBucketCount - 1);
+}
+
+CallbackProfiler::CallbackProfiler(size_t record_capacity)
+    : clock_read_nanoseconds_(0.0), dropped_count_(0),
+      records_(record_capacity), written_count_(0), read_count_(0),
+      output_(NULL), period_seconds_(0.0), collector_running_(false),
+      stopping_(false) {
+  assert(record_capacity > 0);
+  memset(&current_, 0, sizeof(current_));
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    histograms_[stage].counts.resize(kBucketCount);
+  }
+  ClearHistograms();
+
+  int64_t start = Now();
+  for (int read = 1; read < kClockCalibrationReads; ++read) {
+    Now();
+  }
+  clock_read_nanoseconds_ =
+      static_cast<double>(Now() - start) / kClockCalibrationReads;
+}
+
+CallbackProfiler::~CallbackProfiler() {
+  assert(!collector_running_);  // Stop() must be called after Start().
+}
+
+int64_t CallbackProfiler::Now() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * static_cast<int64_t>(1000000000) + now.tv_nsec;
+}
+
+int64_t CallbackProfiler::Mark() {
+  ++current_.clock_reads;
+  return Now();
+}
+
+int64_t CallbackProfiler::AddStage(Stage stage, int64_t start) {
+  int64_t now = Mark();
+  current_.stage_nanoseconds[stage] += now - start;
+  return now;
+}
+
+void CallbackProfiler::EndCallback(int64_t callback_start,
+                                   int64_t deadline_nanoseconds) {
+  AddStage(CALLBACK, callback_start);
+  current_.deadline_nanoseconds = deadline_nanoseconds;
+
+  // The record is complete before the collector may see it.
+  size_t written_count = written_count_;
+  if (written_count - read_count_ >= records_.size()) {
+    ++dropped_count_;
+  } else {
+    current_.dropped_count = dropped_count_;
+    records_[written_count % records_.size()] = current_;
+    __sync_synchronize();
+    written_count_ = written_count + 1;
+    dropped_count_ = 0;
+  }
+  memset(&current_, 0, sizeof(current_));
+}
+
+void CallbackProfiler::Collect() {
+  size_t written_count = written_count_;
+  __sync_synchronize();
+  for (size_t record = read_count_; record != written_count; ++record) {
+    AddRecord(records_[record % records_.size()]);
+  }
+  // The records are read before the callback may overwrite them.
+  __sync_synchronize();
+  read_count_ = written_count;
+}
+
+void CallbackProfiler::AddRecord(const Record& record) {
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    int64_t nanoseconds = record.stage_nanoseconds[stage];
+    if (nanoseconds == 0) {
+      continue;
+    }
+    Histogram& histogram = histograms_[stage];
+    ++histogram.counts[BucketOf(nanoseconds)];
+    ++histogram.count;
+    histogram.total_nanoseconds += nanoseconds;
+    histogram.max_nanoseconds = max(histogram.max_nanoseconds, nanoseconds);
+  }
+  if (record.deadline_nanoseconds > 0) {
+    double load = static_cast<double>(record.stage_nanoseconds[CALLBACK]) /
+        record.deadline_nanoseconds;
+    late_count_ += load > 1.0;
+    total_load_ += load;
+    max_load_ = max(max_load_, load);
+    deadline_nanoseconds_ = record.deadline_nanoseconds;
+  }
+  dropped_total_ += record.dropped_count;
+  clock_reads_ += record.clock_reads;
+}
+
+void CallbackProfiler::ClearHistograms() {
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    Histogram& histogram = histograms_[stage];
+    fill(histogram.counts.begin(), histogram.counts.end(), 0);
+    histogram.count = 0;
+    histogram.total_nanoseconds = 0;
+    histogram.max_nanoseconds = 0;
+  }
+  late_count_ = 0;
+  dropped_total_ = 0;
+  clock_reads_ = 0;
+  total_load_ = 0.0;
+  max_load_ = 0.0;
+  deadline_nanoseconds_ = 0;
+  interval_start_ = Now();
+}
+
+int64_t CallbackProfiler::Percentile(const Histogram& histogram,
+                                     double fraction) {
+  int64_t rank = static_cast<int64_t>(ceil(fraction * histogram.count));
+  int64_t count = 0;
+  size_t bucket = 0;
+  for (; bucket + 1 < kBucketCount; ++bucket) {
+    count += histogram.counts[bucket];
+    if (count >= rank) {
+      break;
+    }
+  }
+  int64_t upper_bound = static_cast<int64_t>(
+      kFirstBucketNanoseconds * pow(2.0, (bucket + 1.0) / kBucketsPerOctave));
+  return min(upper_bound, histogram.max_nanoseconds);
+}
+
+void CallbackProfiler::Print(FILE* output) {
+  Collect();
+  const Histogram& callbacks = histograms_[CALLBACK];
+  double seconds = 1e-9 * (Now() - interval_start_);
+
+  // The block is printed whole, even if other threads share 'output'.
+  flockfile(output);
+  fprintf(output, "Profile of %lld callbacks over %.1f s, deadline of %.1f "
+          "us, %lld records dropped:\n", (long long)callbacks.count, seconds,
+          1e-3 * deadline_nanoseconds_, (long long)dropped_total_);
+  if (callbacks.count > 0) {
+    fprintf(output, "  %-16s %9s %9s %9s %9s %9s %9s\n", "stage (us)", "runs",
+            "mean", "median", "99%", "99.9%", "max");
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+      const Histogram& histogram = histograms_[stage];
+      if (histogram.count == 0) {
+        continue;
+      }
+      fprintf(output, "  %-16s %9lld %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+              kStageNames[stage], (long long)histogram.count,
+              1e-3 * histogram.total_nanoseconds / histogram.count,
+              1e-3 * Percentile(histogram, 0.5),
+              1e-3 * Percentile(histogram, 0.99),
+              1e-3 * Percentile(histogram, 0.999),
+              1e-3 * histogram.max_nanoseconds);
+    }
+    fprintf(output, "  Load: %.1f%% of the deadline on average, %.1f%% at "
+            "most, %lld callbacks late.\n", 100.0 * total_load_ /
+            callbacks.count, 100.0 * max_load_, (long long)late_count_);
+    double clock_reads = static_cast<double>(clock_reads_) / callbacks.count;
+    fprintf(output, "  Profiling: %.1f clock reads of %.0f ns per callback, "
+            "%.3f%% of the deadline.\n", clock_reads, clock_read_nanoseconds_,
+            deadline_nanoseconds_ > 0 ? 100.0 * clock_reads *
+            clock_read_nanoseconds_ / deadline_nanoseconds_ : 0.0);
+  }
+  fflush(output);
+  funlockfile(output);
+  ClearHistograms();
+}
+
+bool CallbackProfiler::Start(FILE* output, double period_seconds) {
+  assert(!collector_running_);
+  assert(output != NULL);
+  assert(period_seconds > 0.0);
+  output_ = output;
+  period_seconds_ = period_seconds;
+  stopping_ = false;
+  ClearHistograms();
+  if (pthread_create(&collector_thread_, NULL, CollectorThread, this)) {
+    return false;
+  }
+  collector_running_ = true;
+  return true;
+}
+
+void CallbackProfiler::Stop() {
+  assert(collector_running_);
+  stopping_ = true;
+  pthread_join(collector_thread_, NULL);
+  collector_running_ = false;
+  Print(output_);
+}
+
+void* CallbackProfiler::CollectorThread(void* callback_profiler) {
+  CallbackProfiler* profiler =
+      static_cast<CallbackProfiler*>(callback_profiler);
+  int64_t period = static_cast<int64_t>(1e9 * profiler->period_seconds_);
+  int64_t next_print = Now() + period;
+  while (!profiler->stopping_) {
+    usleep(kCollectPeriodMicroseconds);
+    profiler->Collect();
+    if (Now() >= next_print) {
+      profiler->Print(profiler->output_);
+      next_print += period;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,121 @@
+#ifndef CALLBACK_PROFILER_H_
+#define CALLBACK_PROFILER_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// CallbackProfiler times the stages of a real-time callback, such as the JACK
+// process callbacks of jack_pitch_modulator and jack_synthesizer, against the
+// deadline of its period.
+//
+// The callback thread reads the monotonic clock at the boundaries of the
+// stages, sums the times of each stage over the callback, and queues one record
+// per callback in a lock-free ring, without allocating, locking or doing I/O. A
+// collecting thread, either the one started by Start() or the caller of
+// Collect() and Print(), drains the ring into a histogram per stage, and
+// prints their percentiles. Records are dropped, and counted, while the ring is
+// full.
+//
+// A callback costs a clock read per stage boundary, a few per analyzed frame,
+// and the copy of its record. The cost of a clock read is measured by the
+// constructor, and the share of the deadline spent reading the clock is
+// printed with the histograms.
+class CallbackProfiler {
+ public:
+  enum Stage {
+    MIDI,             // Handling of the events of the period.
+    FFT,              // Windowing and forward transforms of frames.
+    PITCH_DETECTION,  // Dominant frequency and targets of frames.
+    SHIFT,            // Phase vocoder analysis and moving of the bins.
+    INVERSE_FFT,      // Inverse transforms and overlap-add of frames.
+    SYNTHESIS,        // Mixing of the voices of a synthesizer.
+    CALLBACK,         // The whole callback.
+    STAGE_COUNT,
+  };
+
+  // Records of up to 'record_capacity' callbacks wait to be collected.
+  explicit CallbackProfiler(size_t record_capacity);
+  ~CallbackProfiler();
+
+  // Callback side, from a single thread. A callback starts with Mark(), which
+  // returns the start of its first stage. AddStage() adds the time since
+  // 'start' to 'stage' and returns the start of the next stage. EndCallback()
+  // adds the time since 'callback_start' as a whole and queues the record.
+  int64_t Mark();
+  int64_t AddStage(Stage stage, int64_t start);
+  void EndCallback(int64_t callback_start, int64_t deadline_nanoseconds);
+
+  // Collecting side, from a single thread. Collect() drains the queued
+  // records into the histograms. Print() collects, prints the histograms since
+  // they were last printed to 'output', and clears them.
+  void Collect();
+  void Print(FILE* output);
+
+  // Collect from a new thread, and print to 'output' every 'period_seconds'.
+  // Stop() collects and prints a last time, and joins the thread. Collect()
+  // and Print() may not be called in between.
+  bool Start(FILE* output, double period_seconds);
+  void Stop();
+
+  // Monotonic time, in nanoseconds.
+  static int64_t Now();
+
+ private:
+  // Times of a callback, in nanoseconds, 0 for stages which did not run.
+  struct Record {
+    int64_t stage_nanoseconds[STAGE_COUNT];
+    int64_t deadline_nanoseconds;
+    int clock_reads;
+    int dropped_count;  // Records dropped before this one, the ring full.
+  };
+
+  // Logarithmic buckets of stage times.
+  struct Histogram {
+    std::vector<int64_t> counts;
+    int64_t count;
+    int64_t total_nanoseconds;
+    int64_t max_nanoseconds;
+  };
+
+  void AddRecord(const Record& record);
+  void ClearHistograms();
+
+  // The upper bound of the bucket below which 'fraction' of the times of
+  // 'histogram' lie, in nanoseconds.
+  static int64_t Percentile(const Histogram& histogram, double fraction);
+
+  static void* CollectorThread(void* profiler);
+
+  double clock_read_nanoseconds_;  // Measured cost of a clock read.
+
+  // Owned by the callback thread.
+  Record current_;
+  int dropped_count_;
+
+  // Records between 'read_count_' and 'written_count_', modulo the capacity,
+  // are queued. Each count is only written by its own side.
+  std::vector<Record> records_;
+  volatile size_t written_count_;
+  volatile size_t read_count_;
+
+  // Owned by the collecting thread.
+  Histogram histograms_[STAGE_COUNT];
+  int64_t late_count_;
+  int64_t dropped_total_;
+  int64_t clock_reads_;
+  double total_load_;  // Sum of the shares of their deadline of callbacks.
+  double max_load_;
+  int64_t deadline_nanoseconds_;  // Of the last callback.
+  int64_t interval_start_;
+
+  FILE* output_;
+  double period_seconds_;
+  pthread_t collector_thread_;
+  bool collector_running_;
+  volatile bool stopping_;
+};
+
+#endif  // CALLBACK_PROFILER_H_
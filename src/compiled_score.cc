@@ -0,0 +1,170 @@
+#include "compiled_score.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+
+using namespace std;
+
+const char kCompiledScoreMagic[4] = { 'M', 'A', 'E', 'C' };
+const uint32_t kCompiledScoreByteOrder = 0x01020304;
+
+struct CompiledScoreHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t sample_rate;
+  int64_t note_count;
+  int64_t length_samples;
+};
+
+// The note columns directly follow the header, so it must keep them aligned.
+typedef char CompiledScoreHeaderIsPacked[
+    sizeof(CompiledScoreHeader) == 32 ? 1 : -1];
+
+// Bytes taken by the columns of a single note.
+const size_t kCompiledNoteSize = 2 * sizeof(int64_t) + 2 * sizeof(float);
+
+CompiledScore::CompiledScore()
+    : mapping_(NULL), mapping_size_(0), sample_rate_(0), length_samples_(0) {
+}
+
+CompiledScore::~CompiledScore() {
+  Close();
+}
+
+bool CompiledScore::Open(const string& path) {
+  assert(!path.empty());
+  Close();
+
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(file, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(CompiledScoreHeader)) {
+    close(file);
+    return false;
+  }
+  size_t mapping_size = file_stat.st_size;
+  void* mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  const CompiledScoreHeader* header =
+      static_cast<const CompiledScoreHeader*>(mapping);
+  const size_t note_count = header->note_count;
+  bool valid =
+      memcmp(header->magic, kCompiledScoreMagic, sizeof(header->magic)) == 0 &&
+      header->version == kCompiledScoreVersion &&
+      header->byte_order == kCompiledScoreByteOrder &&
+      static_cast<int>(header->sample_rate) > 0 &&
+      header->note_count >= 0 &&
+      header->length_samples >= 0 &&
+      note_count <= (mapping_size - sizeof(*header)) / kCompiledNoteSize &&
+      mapping_size == sizeof(*header) + note_count * kCompiledNoteSize;
+  if (!valid) {
+    munmap(mapping, mapping_size);
+    return false;
+  }
+
+  NoteSpan notes;
+  if (note_count > 0) {
+    const char* columns = static_cast<const char*>(mapping) + sizeof(*header);
+    notes.start_samples = reinterpret_cast<const int64_t*>(columns);
+    notes.length_samples = notes.start_samples + note_count;
+    notes.frequencies =
+        reinterpret_cast<const float*>(notes.length_samples + note_count);
+    notes.amplitudes = notes.frequencies + note_count;
+    notes.size = note_count;
+  }
+
+  // The renderer relies on the onsets being sorted, on notes lying within the
+  // score, on lengths fitting the int of a VoiceBatch and on the ranges the
+  // instrument asserts, so a single pass over the columns is made to reject
+  // corrupt files. NaNs fail the comparisons.
+  const int64_t length_samples = header->length_samples;
+  for (size_t note = 0; note < notes.size && valid; ++note) {
+    int64_t start = notes.start_samples[note];
+    int64_t length = notes.length_samples[note];
+    valid = start >= 0 && length >= 0 && length <= INT_MAX &&
+            start <= length_samples && length <= length_samples - start &&
+            (note == 0 || notes.start_samples[note - 1] <= start) &&
+            notes.frequencies[note] >= 0.0f &&
+            notes.amplitudes[note] >= 0.0f && notes.amplitudes[note] <= 1.0f;
+  }
+  if (!valid) {
+    munmap(mapping, mapping_size);
+    return false;
+  }
+
+  mapping_ = mapping;
+  mapping_size_ = mapping_size;
+  sample_rate_ = header->sample_rate;
+  length_samples_ = header->length_samples;
+  notes_ = notes;
+  return true;
+}
+
+void CompiledScore::Close() {
+  if (mapping_ != NULL) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = NULL;
+  mapping_size_ = 0;
+  sample_rate_ = 0;
+  length_samples_ = 0;
+  notes_ = NoteSpan();
+}
+
+bool CompiledScore::Write(const string& path,
+                          const NoteSpan& notes,
+                          int sample_rate,
+                          int64_t length_samples) {
+  assert(!path.empty());
+  assert(sample_rate > 0);
+  assert(length_samples >= 0);
+
+  CompiledScoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kCompiledScoreMagic, sizeof(header.magic));
+  header.version = kCompiledScoreVersion;
+  header.byte_order = kCompiledScoreByteOrder;
+  header.sample_rate = sample_rate;
+  header.note_count = notes.size;
+  // Rounding notes to samples may end them just past the score, which is then
+  // extended to cover them, as Open() requires.
+  header.length_samples = length_samples;
+  for (size_t note = 0; note < notes.size; ++note) {
+    header.length_samples =
+        max(header.length_samples,
+            notes.start_samples[note] + notes.length_samples[note]);
+  }
+
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == NULL) {
+    return false;
+  }
+  const size_t note_count = notes.size;
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(notes.start_samples, sizeof(int64_t), note_count, file) ==
+          note_count &&
+      fwrite(notes.length_samples, sizeof(int64_t), note_count, file) ==
+          note_count &&
+      fwrite(notes.frequencies, sizeof(float), note_count, file) ==
+          note_count &&
+      fwrite(notes.amplitudes, sizeof(float), note_count, file) == note_count;
+  bool closed = fclose(file) == 0;
+  return written && closed;
+}
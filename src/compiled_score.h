@@ -0,0 +1,67 @@
+#ifndef COMPILED_SCORE_H_
+#define COMPILED_SCORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "note_table.h"
+
+// Version of the compiled score format written by CompiledScore::Write(). Files
+// of any other version are rejected.
+const uint32_t kCompiledScoreVersion = 1;
+
+// CompiledScore gives access to a compiled (.maec) score, a fully flattened
+// score which can be rendered without parsing. The file is mapped into memory
+// and its note columns are used in place.
+//
+// The format, in the byte order of the machine which wrote it, is:
+//
+//   char magic[4]            "MAEC"
+//   uint32 version           kCompiledScoreVersion
+//   uint32 byte_order        0x01020304
+//   uint32 sample_rate       Samples / second.
+//   int64 note_count
+//   int64 length_samples     Samples in the whole score.
+//   int64 start_samples[note_count]    Sorted, samples from score start.
+//   int64 length_samples[note_count]   Samples.
+//   float frequencies[note_count]      Hz.
+//   float amplitudes[note_count]       [0-1].
+//
+// Instances are expanded when compiling. The CompiledScore interface is not
+// thread-safe.
+class CompiledScore {
+ public:
+  CompiledScore();
+  ~CompiledScore();
+
+  // Map a compiled score. Returns false if the file cannot be read, or is not a
+  // well formed compiled score of the current version and host byte order:
+  // notes must be sorted, lie within the score, be at most INT_MAX samples
+  // long, and have non-negative frequencies and amplitudes within [0-1].
+  bool Open(const std::string& path);
+  void Close();
+
+  int sample_rate() const { return sample_rate_; }
+  int64_t length_samples() const { return length_samples_; }
+
+  // The notes of the score, sorted by onset. Valid until the score is closed.
+  const NoteSpan& notes() const { return notes_; }
+
+  // Write onset-sorted 'notes' at 'sample_rate' as a compiled score of
+  // 'length_samples' samples, or up to the end of the last note if later.
+  // Returns false on I/O errors.
+  static bool Write(const std::string& path,
+                    const NoteSpan& notes,
+                    int sample_rate,
+                    int64_t length_samples);
+
+ private:
+  void* mapping_;  // NULL when no score is open.
+  size_t mapping_size_;
+  int sample_rate_;
+  int64_t length_samples_;
+  NoteSpan notes_;
+};
+
+#endif  // COMPILED_SCORE_H_
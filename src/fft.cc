@@ -1,21 +1,383 @@
 #include <assert.h>
 #include <fftw3.h>
-#include <string.h>
+#include <pthread.h>
 #include <cmath>
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 
 #include "fft.h"
 #include "util-inl.h"
 
 using namespace std;
 
-double Magnitude2(const fftw_complex& value) {
+// Spectrogram frames transformed by each batched plan. Bounds the plans, and
+// the memory measured while planning, whatever the length of the signal.
+const size_t kSpectrogramBatchFrames = 64;
+
+// The FFTW interface of each supported precision.
+template <typename Real>
+struct FFTW;
+
+template <>
+struct FFTW<double> {
+  typedef FFTWTypes<double>::Complex Complex;
+  typedef FFTWTypes<double>::Plan Plan;
+
+  static double* AllocReal(size_t count) { return fftw_alloc_real(count); }
+  static Complex* AllocComplex(size_t count) {
+    return fftw_alloc_complex(count);
+  }
+  static void Free(void* array) { fftw_free(array); }
+  static int AlignmentOf(double* array) { return fftw_alignment_of(array); }
+  static Plan PlanR2C(int count, double* in, Complex* out, unsigned flags) {
+    return fftw_plan_dft_r2c_1d(count, in, out, flags);
+  }
+  static Plan PlanManyR2C(int count, int howmany, double* in, Complex* out,
+                          unsigned flags) {
+    return fftw_plan_many_dft_r2c(1, &count, howmany, in, NULL, 1, count, out,
+                                 NULL, 1, count / 2 + 1, flags);
+  }
+  static Plan PlanC2R(int count, Complex* in, double* out, unsigned flags) {
+    return fftw_plan_dft_c2r_1d(count, in, out, flags);
+  }
+  static void ExecuteR2C(Plan plan, double* in, Complex* out) {
+    fftw_execute_dft_r2c(plan, in, out);
+  }
+  static void ExecuteC2R(Plan plan, Complex* in, double* out) {
+    fftw_execute_dft_c2r(plan, in, out);
+  }
+  static void DestroyPlan(Plan plan) { fftw_destroy_plan(plan); }
+  static int ImportWisdom(const char* path) {
+    return fftw_import_wisdom_from_filename(path);
+  }
+  static int ExportWisdom(const char* path) {
+    return fftw_export_wisdom_to_filename(path);
+  }
+};
+
+template <>
+struct FFTW<float> {
+  typedef FFTWTypes<float>::Complex Complex;
+  typedef FFTWTypes<float>::Plan Plan;
+
+  static float* AllocReal(size_t count) { return fftwf_alloc_real(count); }
+  static Complex* AllocComplex(size_t count) {
+    return fftwf_alloc_complex(count);
+  }
+  static void Free(void* array) { fftwf_free(array); }
+  static int AlignmentOf(float* array) { return fftwf_alignment_of(array); }
+  static Plan PlanR2C(int count, float* in, Complex* out, unsigned flags) {
+    return fftwf_plan_dft_r2c_1d(count, in, out, flags);
+  }
+  static Plan PlanManyR2C(int count, int howmany, float* in, Complex* out,
+                          unsigned flags) {
+    return fftwf_plan_many_dft_r2c(1, &count, howmany, in, NULL, 1, count, out,
+                                 NULL, 1, count / 2 + 1, flags);
+  }
+  static Plan PlanC2R(int count, Complex* in, float* out, unsigned flags) {
+    return fftwf_plan_dft_c2r_1d(count, in, out, flags);
+  }
+  static void ExecuteR2C(Plan plan, float* in, Complex* out) {
+    fftwf_execute_dft_r2c(plan, in, out);
+  }
+  static void ExecuteC2R(Plan plan, Complex* in, float* out) {
+    fftwf_execute_dft_c2r(plan, in, out);
+  }
+  static void DestroyPlan(Plan plan) { fftwf_destroy_plan(plan); }
+  static int ImportWisdom(const char* path) {
+    return fftwf_import_wisdom_from_filename(path);
+  }
+  static int ExportWisdom(const char* path) {
+    return fftwf_export_wisdom_to_filename(path);
+  }
+};
+
+// Identifies the transforms a plan may execute.
+struct PlanKey {
+  PlanKey(size_t count, int transform_direction, bool aligned_arrays,
+          size_t frames)
+      : sample_count(count), direction(transform_direction),
+        aligned(aligned_arrays), frame_count(frames) {}
+
+  bool operator<(const PlanKey& key) const {
+    if (sample_count != key.sample_count) {
+      return sample_count < key.sample_count;
+    }
+    if (frame_count != key.frame_count) {
+      return frame_count < key.frame_count;
+    }
+    if (direction != key.direction) {
+      return direction < key.direction;
+    }
+    return aligned < key.aligned;
+  }
+
+  size_t sample_count;
+  int direction;  // FFTW_FORWARD (real to complex) or FFTW_BACKWARD.
+  bool aligned;   // Whether the arrays have fftw_malloc() alignment.
+  size_t frame_count;  // Consecutive transforms done at once.
+};
+
+// Unlike executing plans, the FFTW planners and wisdom are not thread-safe, so
+// they are only used with 'plan_mutex' held. It also guards the plan caches.
+pthread_mutex_t plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The plans of each precision.
+template <typename Real>
+struct PlanCache {
+  static map<PlanKey, typename FFTW<Real>::Plan> plans;
+};
+
+template <typename Real>
+map<PlanKey, typename FFTW<Real>::Plan> PlanCache<Real>::plans;
+
+template <typename Real>
+bool Aligned(Real* real, typename FFTW<Real>::Complex* complex) {
+  return FFTW<Real>::AlignmentOf(real) == 0 &&
+      FFTW<Real>::AlignmentOf(reinterpret_cast<Real*>(complex)) == 0;
+}
+
+// Find or create the plan for a transform, or for 'frame_count' forward
+// transforms of consecutive frames at once. Plans are applied to the arrays at
+// hand with the new-array execute functions.
+template <typename Real>
+typename FFTW<Real>::Plan GetPlan(size_t sample_count, int direction,
+                                  bool aligned, size_t frame_count = 1) {
+  typedef typename FFTW<Real>::Complex Complex;
+  assert(frame_count == 1 || direction == FFTW_FORWARD);
+  pthread_mutex_lock(&plan_mutex);
+  typename FFTW<Real>::Plan& plan = PlanCache<Real>::plans[
+      PlanKey(sample_count, direction, aligned, frame_count)];
+  if (plan == NULL) {
+    // Measuring overwrites the arrays, so plans are created on scratch ones.
+    Real* real = FFTW<Real>::AllocReal(sample_count * frame_count);
+    Complex* complex =
+        FFTW<Real>::AllocComplex((sample_count / 2 + 1) * frame_count);
+    unsigned flags = FFTW_MEASURE | (aligned ? 0 : FFTW_UNALIGNED);
+    if (frame_count > 1) {
+      plan = FFTW<Real>::PlanManyR2C(sample_count, frame_count, real, complex,
+                                     flags);
+    } else if (direction == FFTW_FORWARD) {
+      plan = FFTW<Real>::PlanR2C(sample_count, real, complex, flags);
+    } else {
+      plan = FFTW<Real>::PlanC2R(sample_count, complex, real,
+                                 flags | FFTW_PRESERVE_INPUT);
+    }
+    assert(plan != NULL);
+    FFTW<Real>::Free(complex);
+    FFTW<Real>::Free(real);
+  }
+  pthread_mutex_unlock(&plan_mutex);
+  return plan;
+}
+
+// The array a transform reads its real samples from: the samples themselves if
+// they have the transform's precision, or else 'work' holding a converted copy.
+template <typename Real, typename SampleType>
+Real* RealInput(SampleType* samples, size_t sample_count, Real* work) {
+  CastCopy(work, samples, sample_count);
+  return work;
+}
+
+template <typename Real>
+Real* RealInput(Real* samples, size_t sample_count, Real* work) {
+  return samples;
+}
+
+// The array a transform writes its real samples to, chosen like RealInput().
+// Samples are converted from 'work' by ScaleOutput().
+template <typename Real, typename SampleType>
+Real* RealOutput(SampleType* samples, Real* work) {
+  return work;
+}
+
+template <typename Real>
+Real* RealOutput(Real* samples, Real* work) {
+  return samples;
+}
+
+// Scale the samples written to 'output' by 'scale_factor' into 'samples'.
+template <typename Real, typename SampleType>
+void ScaleOutput(const Real* output, size_t sample_count, Real scale_factor,
+                 SampleType* samples) {
+  for (size_t sample = 0; sample < sample_count; ++sample) {
+    samples[sample] = static_cast<SampleType>(output[sample] * scale_factor);
+  }
+}
+
+template <typename Real>
+void FFT<Real>::FFTDecomposition::Resize(size_t new_sample_count) {
+  if (new_sample_count == sample_count) {
+    return;
+  }
+  if (fft_decomposition != NULL) {
+    FFTW<Real>::Free(fft_decomposition);
+    fft_decomposition = NULL;
+  }
+  if (samples != NULL) {
+    FFTW<Real>::Free(samples);
+    samples = NULL;
+  }
+  sample_count = new_sample_count;
+  ClearPlans();
+  if (sample_count > 0) {
+    fft_decomposition = FFTW<Real>::AllocComplex(sample_count / 2 + 1);
+    samples = FFTW<Real>::AllocReal(sample_count);
+  }
+}
+
+template <typename Real>
+void FFT<Real>::Spectrogram::Resize(size_t new_frame_count,
+                                    size_t new_frame_size) {
+  if (new_frame_count == frame_count && new_frame_size == frame_size) {
+    return;
+  }
+  if (frames != NULL) {
+    FFTW<Real>::Free(frames);
+    FFTW<Real>::Free(spectra);
+    FFTW<Real>::Free(magnitudes);
+    frames = NULL;
+    spectra = NULL;
+    magnitudes = NULL;
+  }
+  frame_count = new_frame_count;
+  frame_size = new_frame_size;
+  bin_count = frame_size > 0 ? frame_size / 2 + 1 : 0;
+  if (frame_count > 0 && frame_size > 0) {
+    frames = FFTW<Real>::AllocReal(frame_count * frame_size);
+    spectra = FFTW<Real>::AllocComplex(frame_count * bin_count);
+    magnitudes = FFTW<Real>::AllocReal(frame_count * bin_count);
+  }
+}
+
+// The plan of a decomposition for a transform, found once in the cache.
+template <typename Real>
+typename FFTW<Real>::Plan DecompositionPlan(
+    typename FFTW<Real>::Plan* plans, size_t sample_count, int direction,
+    bool aligned) {
+  if (plans[aligned] == NULL) {
+    plans[aligned] = GetPlan<Real>(sample_count, direction, aligned);
+  }
+  return plans[aligned];
+}
+
+template <typename Real>
+void FFT<Real>::PreparePlans(size_t sample_count,
+                             FFTDecomposition* fft_decomposition) {
+  assert(sample_count > 0);
+  GetPlan<Real>(sample_count, FFTW_FORWARD, true);
+  GetPlan<Real>(sample_count, FFTW_BACKWARD, true);
+  if (fft_decomposition != NULL) {
+    fft_decomposition->Resize(sample_count);
+    DecompositionPlan<Real>(fft_decomposition->forward_plans, sample_count,
+                            FFTW_FORWARD, true);
+    DecompositionPlan<Real>(fft_decomposition->backward_plans, sample_count,
+                            FFTW_BACKWARD, true);
+  }
+}
+
+template <typename Real>
+void FFT<Real>::DestroyPlans() {
+  typedef map<PlanKey, typename FFTW<Real>::Plan> PlanMap;
+  pthread_mutex_lock(&plan_mutex);
+  PlanMap& plans = PlanCache<Real>::plans;
+  for (typename PlanMap::iterator plan = plans.begin(); plan != plans.end();
+       ++plan) {
+    FFTW<Real>::DestroyPlan(plan->second);
+  }
+  plans.clear();
+  pthread_mutex_unlock(&plan_mutex);
+}
+
+template <typename Real>
+bool FFT<Real>::ImportWisdom(const string& path) {
+  pthread_mutex_lock(&plan_mutex);
+  bool imported = FFTW<Real>::ImportWisdom(path.c_str()) != 0;
+  pthread_mutex_unlock(&plan_mutex);
+  return imported;
+}
+
+template <typename Real>
+bool FFT<Real>::ExportWisdom(const string& path) {
+  pthread_mutex_lock(&plan_mutex);
+  bool exported = FFTW<Real>::ExportWisdom(path.c_str()) != 0;
+  pthread_mutex_unlock(&plan_mutex);
+  return exported;
+}
+
+// The frames [begin_frame, end_frame) of a spectrogram, transformed by a
+// single thread.
+template <typename Real, typename SampleType>
+struct SpectrogramSlice {
+  const SampleType* samples;
+  const Real* window;
+  typename FFT<Real>::Spectrogram* spectrogram;
+  size_t begin_frame;
+  size_t end_frame;
+};
+
+template <typename Real, typename SampleType>
+void TransformSpectrogramSlice(
+    const SpectrogramSlice<Real, SampleType>& slice) {
+  typename FFT<Real>::Spectrogram* spectrogram = slice.spectrogram;
+  size_t frame_size = spectrogram->frame_size;
+  size_t bin_count = spectrogram->bin_count;
+  for (size_t frame = slice.begin_frame; frame < slice.end_frame; ++frame) {
+    const SampleType* samples = slice.samples + frame * spectrogram->hop_size;
+    Real* windowed = spectrogram->frames + frame * frame_size;
+    if (slice.window == NULL) {
+      CastCopy(windowed, samples, frame_size);
+    } else {
+      for (size_t sample = 0; sample < frame_size; ++sample) {
+        windowed[sample] = samples[sample] * slice.window[sample];
+      }
+    }
+  }
+
+  // Whole batches, then single frames.
+  size_t frame = slice.begin_frame;
+  while (frame < slice.end_frame) {
+    size_t batch_frames = slice.end_frame - frame >= kSpectrogramBatchFrames
+        ? kSpectrogramBatchFrames : 1;
+    Real* frames = spectrogram->frames + frame * frame_size;
+    typename FFT<Real>::Complex* spectra =
+        spectrogram->spectra + frame * bin_count;
+    FFTW<Real>::ExecuteR2C(
+        GetPlan<Real>(frame_size, FFTW_FORWARD, Aligned(frames, spectra),
+                      batch_frames),
+        frames, spectra);
+    frame += batch_frames;
+  }
+
+  const typename FFT<Real>::Complex* spectra =
+      spectrogram->spectra + slice.begin_frame * bin_count;
+  Real* magnitudes = spectrogram->magnitudes + slice.begin_frame * bin_count;
+  size_t value_count = (slice.end_frame - slice.begin_frame) * bin_count;
+  for (size_t value = 0; value < value_count; ++value) {
+    magnitudes[value] = sqrt(spectra[value][0] * spectra[value][0] +
+                             spectra[value][1] * spectra[value][1]);
+  }
+}
+
+template <typename Real, typename SampleType>
+void* TransformSpectrogramSliceThread(void* slice) {
+  TransformSpectrogramSlice(
+      *static_cast<SpectrogramSlice<Real, SampleType>*>(slice));
+  return NULL;
+}
+
+template <typename Complex>
+double Magnitude2(const Complex& value) {
   return value[0] * value[0] + value[1] * value[1];
 }
 
-double Magnitude(const fftw_complex& value, size_t sample_count) {
+template <typename Complex>
+double Magnitude(const Complex& value, size_t sample_count) {
   return std::sqrt(value[0] * value[0] + value[1] * value[1]) /
       static_cast<double>(sample_count);
 }
@@ -36,85 +398,99 @@ bool PeakOfParabolicFit(const Type samples[3], Type *peak) {
   return !std::isinf(*peak) && *peak >= -0.5 && *peak < 0.5;
 }
 
+template <typename Real>
 template <typename SampleType>
-bool FFT::FFTDecompose(size_t sample_count,
-                       SampleType* samples,
-                       FFTDecomposition* fft_decomposition) {
+bool FFT<Real>::FFTDecompose(size_t sample_count,
+                             SampleType* samples,
+                             FFTDecomposition* fft_decomposition) {
   assert(sample_count > 0);
   assert(samples != NULL);
   assert(fft_decomposition != NULL);
 
-  // Perform the discrete Fourier transform. Since we use the fftw library, we
-  // need to put the samples in a format it can understand. TODO: We can skip
-  // the copy if SampleType is of type double.
-  double* fftw_samples = (double*)fftw_malloc(sample_count * sizeof(double));
-  size_t scale_count = sample_count / 2 + 1;
-  fft_decomposition->fft_decomposition =
-      (fftw_complex*)fftw_malloc(scale_count * sizeof(fftw_complex));
-  fftw_plan fftw_dft_plan =
-      fftw_plan_dft_r2c_1d(sample_count,
-                           fftw_samples,
-                           fft_decomposition->fft_decomposition,
-                           0);
-  fft_decomposition->sample_count = sample_count;
-  CastCopy(fftw_samples, samples, sample_count);
-  fftw_execute(fftw_dft_plan);
-  fftw_destroy_plan(fftw_dft_plan);
-  fftw_free(fftw_samples);
+  // Perform the discrete Fourier transform. Since we use the fftw library,
+  // samples of another precision are first converted to one it understands.
+  fft_decomposition->Resize(sample_count);
+  Real* input = RealInput(samples, sample_count, fft_decomposition->samples);
+  FFTW<Real>::ExecuteR2C(
+      DecompositionPlan<Real>(
+          fft_decomposition->forward_plans, sample_count, FFTW_FORWARD,
+          Aligned(input, fft_decomposition->fft_decomposition)),
+      input, fft_decomposition->fft_decomposition);
+  return true;
 }
 
+template <typename Real>
 template <typename SampleType>
-bool FFT::FFTRecompose(const FFTDecomposition& fft_decomposition,
-                       SampleType* samples) {
+bool FFT<Real>::FFTRecompose(const FFTDecomposition& fft_decomposition,
+                             SampleType* samples) {
   assert(fft_decomposition.sample_count > 0);
   assert(samples != NULL);
 
   size_t sample_count = fft_decomposition.sample_count;
-  double* fftw_samples = (double*)fftw_malloc(sample_count * sizeof(double));
-  fftw_plan fftw_dft_plan =
-      fftw_plan_dft_c2r_1d(sample_count,
-                           fft_decomposition.fft_decomposition,
-                           fftw_samples,
-                           FFTW_PRESERVE_INPUT);
-  fftw_execute(fftw_dft_plan);
-  double scale_factor = 1.0 / static_cast<double>(sample_count);
-  for (size_t sample = 0; sample < sample_count; ++sample) {
-    fftw_samples[sample] *= scale_factor;
-  }
-  CastCopy(samples, fftw_samples, sample_count);
-  fftw_destroy_plan(fftw_dft_plan);
-  fftw_free(fftw_samples);
+  Real* output = RealOutput(samples, fft_decomposition.samples);
+  FFTW<Real>::ExecuteC2R(
+      DecompositionPlan<Real>(
+          fft_decomposition.backward_plans, sample_count, FFTW_BACKWARD,
+          Aligned(output, fft_decomposition.fft_decomposition)),
+      fft_decomposition.fft_decomposition, output);
+  Real scale_factor = 1.0 / static_cast<Real>(sample_count);
+  ScaleOutput(output, sample_count, scale_factor, samples);
+  return true;
 }
 
-bool FFT::PitchShift(size_t sample_rate,
-                     double current_frequency,
-                     double target_frequency,
-                     FFTDecomposition* fft_decomposition) {
-  assert(sample_rate > 0);
-  assert(fft_decomposition != NULL);
-  assert(fft_decomposition->sample_count > 0);
-
-  scoped_array<fftw_complex> decomposition(
-      new fftw_complex[fft_decomposition->sample_count]);
-  memcpy(decomposition.get(), fft_decomposition->fft_decomposition,
-         sizeof(fftw_complex) * fft_decomposition->sample_count);
-
-  size_t scale_count =  fft_decomposition->sample_count / 2 + 1;
-  double scale_shift = ((target_frequency - current_frequency) /
-                        (sample_rate /  fft_decomposition->sample_count));
-  for (size_t f = 0; f < scale_count - 1; ++f) {
-    int source_bin = f - scale_shift;
-    if (source_bin < 0 || source_bin >= fft_decomposition->sample_count) {
-      fft_decomposition->fft_decomposition[f][0] =
-          fft_decomposition->fft_decomposition[f][1] = 0;
-    } else {
-      fft_decomposition->fft_decomposition[f][0] = decomposition[source_bin][0];
-      fft_decomposition->fft_decomposition[f][1] = decomposition[source_bin][1];
-    }
+template <typename Real>
+template <typename SampleType>
+bool FFT<Real>::ComputeSpectrogram(const SampleType* samples,
+                                   size_t sample_count,
+                                   const Real* window,
+                                   size_t frame_size,
+                                   size_t hop_size,
+                                   int thread_count,
+                                   Spectrogram* spectrogram) {
+  assert(samples != NULL);
+  assert(frame_size > 0);
+  assert(hop_size > 0);
+  assert(thread_count > 0);
+  assert(spectrogram != NULL);
+
+  if (sample_count < frame_size) {
+    return false;
+  }
+  size_t frame_count = (sample_count - frame_size) / hop_size + 1;
+  spectrogram->Resize(frame_count, frame_size);
+  spectrogram->hop_size = hop_size;
+
+  // Threads take whole batches, the last one the remaining frames.
+  size_t batch_count = (frame_count + kSpectrogramBatchFrames - 1) /
+      kSpectrogramBatchFrames;
+  size_t slice_count = min<size_t>(thread_count, batch_count);
+  vector<SpectrogramSlice<Real, SampleType> > slices(slice_count);
+  for (size_t slice = 0; slice < slice_count; ++slice) {
+    slices[slice].samples = samples;
+    slices[slice].window = window;
+    slices[slice].spectrogram = spectrogram;
+    slices[slice].begin_frame =
+        batch_count * slice / slice_count * kSpectrogramBatchFrames;
+    slices[slice].end_frame = min(
+        frame_count,
+        batch_count * (slice + 1) / slice_count * kSpectrogramBatchFrames);
+  }
+  vector<pthread_t> threads(slice_count);
+  for (size_t slice = 1; slice < slice_count; ++slice) {
+    int error = pthread_create(
+        &threads[slice], NULL,
+        TransformSpectrogramSliceThread<Real, SampleType>, &slices[slice]);
+    assert(!error);
+  }
+  TransformSpectrogramSlice(slices[0]);
+  for (size_t slice = 1; slice < slice_count; ++slice) {
+    pthread_join(threads[slice], NULL);
   }
+  return true;
 }
 
-bool FFT::FindDominantFrequency(const FFTDecomposition& fft_decomposition,
+template <typename Real>
+bool FFT<Real>::FindDominantFrequency(const FFTDecomposition& fft_decomposition,
                                 size_t sample_rate,
 				double* dominant_frequency) {
   assert(fft_decomposition.sample_count > 0);
@@ -127,35 +503,64 @@ bool FFT::FindDominantFrequency(const FFTDecomposition& fft_decomposition,
   // parabola to filter responses.
   size_t sample_count = fft_decomposition.sample_count;
   size_t scale_count = sample_count / 2 + 1;
-  scoped_array<double> fft_magnitudes(new double[scale_count]);
-  double max_magnitude = 0;
+  const Complex* scales = fft_decomposition.fft_decomposition;
+  double max_magnitude = numeric_limits<double>::epsilon();
   size_t max_scale = 0;
-  for (size_t scale = 1; scale < scale_count - 1; ++scale) {
-    double magnitude = Magnitude2(fft_decomposition.fft_decomposition[scale]);
-    if (magnitude <= numeric_limits<double>::epsilon()) {
-      continue;
-    }
+  for (size_t scale = 1; scale + 1 < scale_count; ++scale) {
+    double magnitude = Magnitude2(scales[scale]);
     if (magnitude > max_magnitude) {
       max_magnitude = magnitude;
       max_scale = scale;
     }
-    fft_magnitudes[scale] = magnitude;
   }
 
-  if (max_scale == 0 || max_scale >= scale_count) {
+  if (max_scale == 0) {
     return false;
   }
 
+  // A peak which does not fit a parabola is taken at its bin.
+  double peak_magnitudes[3];
+  for (size_t scale = 0; scale < 3; ++scale) {
+    double magnitude = Magnitude2(scales[max_scale - 1 + scale]);
+    peak_magnitudes[scale] =
+        magnitude <= numeric_limits<double>::epsilon() ? 0.0 : magnitude;
+  }
   double scale_offset;
-  assert(PeakOfParabolicFit(fft_magnitudes.get() + max_scale - 1, &scale_offset));
+  if (!PeakOfParabolicFit(peak_magnitudes, &scale_offset)) {
+    scale_offset = 0.0;
+  }
   double refined_scale = max_scale + scale_offset;
   *dominant_frequency = refined_scale * sample_rate / sample_count;
   return true;
 }
 
 // Explicit template instantiations for known valid types.
-template bool FFT::FFTDecompose<double>(size_t, double*, FFTDecomposition*);
-template bool FFT::FFTDecompose<float>(size_t, float*, FFTDecomposition*);
+template class FFT<double>;
+template class FFT<float>;
+
+template bool FFT<double>::FFTDecompose<double>(size_t, double*,
+                                                FFTDecomposition*);
+template bool FFT<double>::FFTDecompose<float>(size_t, float*,
+                                               FFTDecomposition*);
+template bool FFT<float>::FFTDecompose<double>(size_t, double*,
+                                               FFTDecomposition*);
+template bool FFT<float>::FFTDecompose<float>(size_t, float*,
+                                              FFTDecomposition*);
+
+template bool FFT<double>::ComputeSpectrogram<double>(
+    const double*, size_t, const double*, size_t, size_t, int, Spectrogram*);
+template bool FFT<double>::ComputeSpectrogram<float>(
+    const float*, size_t, const double*, size_t, size_t, int, Spectrogram*);
+template bool FFT<float>::ComputeSpectrogram<double>(
+    const double*, size_t, const float*, size_t, size_t, int, Spectrogram*);
+template bool FFT<float>::ComputeSpectrogram<float>(
+    const float*, size_t, const float*, size_t, size_t, int, Spectrogram*);
 
-template bool FFT::FFTRecompose<double>(const FFTDecomposition&, double*);
-template bool FFT::FFTRecompose<float>(const FFTDecomposition&, float*);
+template bool FFT<double>::FFTRecompose<double>(const FFTDecomposition&,
+                                                double*);
+template bool FFT<double>::FFTRecompose<float>(const FFTDecomposition&,
+                                               float*);
+template bool FFT<float>::FFTRecompose<double>(const FFTDecomposition&,
+                                               double*);
+template bool FFT<float>::FFTRecompose<float>(const FFTDecomposition&,
+                                              float*);
@@ -2,46 +2,157 @@
 #define FFT_H_
 
 #include <fftw3.h>
+#include <stddef.h>
+#include <string>
+
+// The FFTW types of each supported precision.
+template <typename Real>
+struct FFTWTypes;
+
+template <>
+struct FFTWTypes<double> {
+  typedef fftw_complex Complex;
+  typedef fftw_plan Plan;
+};
+
+template <>
+struct FFTWTypes<float> {
+  typedef fftwf_complex Complex;
+  typedef fftwf_plan Plan;
+};
 
 // Collection of high level routines for signal analysis using the Fast Fourier
-// Transformation.
+// Transformation, computed at the precision of 'Real', float or double. Samples
+// of that type are transformed in place of a converted copy, so float is the
+// cheaper choice for real-time audio and double remains for offline analysis.
+//
+// FFTW plans are created once per transform size and kind, and shared by all
+// threads. Creating a plan measures the fastest algorithm and takes far longer
+// than the transform itself, so real-time callers should create their plans in
+// advance with PreparePlans(), and long-running processes may import wisdom
+// saved by an earlier run to skip the measurements.
+template <typename Real>
 class FFT {
  public:
+  typedef typename FFTWTypes<Real>::Complex Complex;
+  typedef typename FFTWTypes<Real>::Plan Plan;
+
+  struct FFTDecomposition;
+
+  // Create the plans for transforms of 'sample_count' samples, unless they
+  // already exist. Given a decomposition, also size it and keep the plans in
+  // it, so that its transforms neither allocate nor lock.
+  static void PreparePlans(size_t sample_count,
+                           FFTDecomposition* fft_decomposition = NULL);
+
+  // Destroy all plans. No transform may run at the same time.
+  static void DestroyPlans();
+
+  // Load or save FFTW wisdom, the measurements behind plans, from or to a file.
+  // Wisdom should be imported before any plan is created. Return false if the
+  // file cannot be read or written.
+  static bool ImportWisdom(const std::string& path);
+  static bool ExportWisdom(const std::string& path);
+
+  // The buffers of a decomposition are kept and reused by further transforms
+  // of the same size, as are the plans found by its first transforms.
   struct FFTDecomposition {
-    FFTDecomposition() : fft_decomposition(NULL) {}
-    ~FFTDecomposition() {
-      if (fft_decomposition != NULL) {
-        fftw_free(fft_decomposition);
-      }
+    FFTDecomposition()
+        : fft_decomposition(NULL), samples(NULL), sample_count(0) {
+      ClearPlans();
     }
+    ~FFTDecomposition() { Resize(0); }
+
+    // (Re)allocate the buffers for transforms of 'sample_count' samples.
+    void Resize(size_t sample_count);
 
     // Element 1 of the component vector is the at "DC" and element
     // sample_count/2 is at the Nyquist frequency. The component vector is
     // sample_count/2+1 elements.
-    fftw_complex* fft_decomposition;
+    Complex* fft_decomposition;
+    Real* samples;  // Work buffer of sample_count real samples.
     size_t sample_count;
+
+    // Shared plans of the forward and backward transforms, indexed by whether
+    // the transformed arrays are aligned. NULL until first needed.
+    mutable Plan forward_plans[2];
+    mutable Plan backward_plans[2];
+
+   private:
+    void ClearPlans() {
+      forward_plans[0] = forward_plans[1] = NULL;
+      backward_plans[0] = backward_plans[1] = NULL;
+    }
+
+    FFTDecomposition(const FFTDecomposition&);
+    void operator=(const FFTDecomposition&);
   };
 
-  // Decompose a 1D signal into the Fourier domain.
+  // The short-time Fourier transform of a signal: the spectra of frames of
+  // 'frame_size' samples starting every 'hop_size' samples. Spectra and their
+  // magnitudes are stored as contiguous frame_count x bin_count matrices, one
+  // row per frame, with bin_count = frame_size / 2 + 1. The buffers are kept
+  // and reused by further spectrograms of the same dimensions.
+  struct Spectrogram {
+    Spectrogram()
+        : frames(NULL), spectra(NULL), magnitudes(NULL), frame_count(0),
+          frame_size(0), hop_size(0), bin_count(0) {}
+    ~Spectrogram() { Resize(0, 0); }
+
+    // (Re)allocate the buffers for 'frame_count' frames of 'frame_size'.
+    void Resize(size_t frame_count, size_t frame_size);
+
+    const Complex* spectrum(size_t frame) const {
+      return spectra + frame * bin_count;
+    }
+    const Real* magnitude(size_t frame) const {
+      return magnitudes + frame * bin_count;
+    }
+
+    Real* frames;  // Work buffer of the windowed frames, frame after frame.
+    Complex* spectra;
+    Real* magnitudes;  // Unnormalized, as the spectra.
+    size_t frame_count;
+    size_t frame_size;
+    size_t hop_size;
+    size_t bin_count;
+
+   private:
+    Spectrogram(const Spectrogram&);
+    void operator=(const Spectrogram&);
+  };
+
+  // Compute the spectrogram of 'sample_count' samples, of the whole frames
+  // which fit. Frames are multiplied by 'window', of 'frame_size' samples,
+  // unless it is NULL. Frames are transformed in batches sharing one FFTW plan,
+  // which are split between 'thread_count' threads. Returns false if the
+  // signal is shorter than a frame.
+  template <typename SampleType>
+  static bool ComputeSpectrogram(const SampleType* samples,
+                                 size_t sample_count,
+                                 const Real* window,
+                                 size_t frame_size,
+                                 size_t hop_size,
+                                 int thread_count,
+                                 Spectrogram* spectrogram);
+
+  // Decompose a 1D signal into the Fourier domain. Samples of type Real are
+  // read where they are, others are first converted into the work buffer.
   template <typename SampleType>
   static bool FFTDecompose(size_t sample_count,
                            SampleType* samples,
                            FFTDecomposition* fft_decomposition);
 
   // Recompose a 1D signal in Fourier space previously decomposed by
-  // FFTDecompose. This function is inverse of FFTDecompose.
+  // FFTDecompose. This function is inverse of FFTDecompose. Samples of type
+  // Real are written directly, others are converted from the work buffer.
   template <typename SampleType>
   static bool FFTRecompose(const FFTDecomposition& fft_decomposition,
                            SampleType* samples);
 
-  // Modify the pitch of a decomposed signal.
-  static bool PitchShift(size_t sample_rate,
-                         double current_frequency,
-                         double target_frequency,
-                         FFTDecomposition* fft_decomposition);
-
   // Find the single most dominant frequency in a signal given a discrete set of
-  // samples. Return value indicates an error.
+  // samples. Returns false if the spectrum has no peak. See PitchTracker for
+  // several pitches, tracked over consecutive frames.
   static bool FindDominantFrequency(const FFTDecomposition& fft_decomposition,
                                     size_t sample_rate,
 				    double* dominant_frequency);
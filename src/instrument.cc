@@ -1,11 +1,90 @@
 #include <assert.h>
+#include <algorithm>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 #include "instrument.h"
 
+// The phasor oscillator advances this many interleaved phasors at once, so that
+// the inner loop is free of dependencies between neighbouring samples.
+const int kPhasorLanes = 4;
+
+// Number of samples after which phasors are re-seeded from the exact phase.
+const int kPhasorReseedInterval = 256;
+
+// Phase of sample 'i' of a tone, as evaluated by the reference oscillator. The
+// index is exact in double precision, as it is not in a float beyond 2^24
+// samples, where phases would otherwise advance in steps of several samples.
+double TonePhase(float frequency, int sample_rate, int i) {
+  return 2.0 * M_PI * double(i) / double(sample_rate) * frequency;
+}
+
+// Synthesis outputs for ToneGeneratorInstrument::Synthesize. Storing writes
+// samples to a buffer while accumulating mixes them into an accumulator.
 template <typename SampleType>
-void ToneGeneratorInstrument<SampleType>::Generate(
+struct StoreSamples {
+  explicit StoreSamples(SampleType* s) : samples(s) {}
+  void operator()(int index, SampleType sample) { samples[index] = sample; }
+
+  SampleType* samples;
+};
+
+template <typename SampleType, typename AccumulatorType>
+struct AccumulateSamples {
+  explicit AccumulateSamples(AccumulatorType* a) : accumulator(a) {}
+  void operator()(int index, SampleType sample) {
+    accumulator[index] += sample;
+  }
+
+  AccumulatorType* accumulator;
+};
+
+template <typename SampleType, typename AccumulatorType>
+void Instrument<SampleType, AccumulatorType>::MixVoices(
+    const VoiceBatch& voices,
+    int sample_rate,  // Samples / second.
+    AccumulatorType* accumulator) {
+  assert(accumulator);
+
+  for (size_t voice = 0; voice < voices.size(); ++voice) {
+    int sample_count = voices.sample_counts[voice];
+    if (sample_count == 0) {
+      continue;
+    }
+    sample_buffer_.resize(std::max<size_t>(sample_buffer_.size(),
+                                           sample_count));
+    // Half a sample of slack ensures Generate() truncates the length back to
+    // the exact note sample count.
+    Generate(voices.frequencies[voice],
+             voices.amplitudes[voice],
+             (voices.length_samples[voice] + 0.5f) / sample_rate,
+             sample_rate,
+             voices.sample_offsets[voice],
+             sample_count,
+             &sample_buffer_.front());
+
+    AccumulatorType* target = accumulator + voices.accumulator_offsets[voice];
+    for (int sample = 0; sample < sample_count; ++sample) {
+      target[sample] += sample_buffer_[sample];
+    }
+  }
+}
+
+// Return the range [*first, *last) of the 'sample_count' samples starting at
+// 'sample_offset' which fall within the note. Samples outside of it are silent.
+void AudibleSampleRange(int note_sample_count,
+                        int sample_offset,
+                        int sample_count,
+                        int* first,
+                        int* last) {
+  *first = std::min(std::max(0, -sample_offset), sample_count);
+  *last = std::max(*first, std::min(sample_count,
+                                    note_sample_count - sample_offset));
+}
+
+template <typename SampleType, typename AccumulatorType>
+void ToneGeneratorInstrument<SampleType, AccumulatorType>::Generate(
     float frequency,  // Hz.
     float amplitude,  // [0-1].
     float length,     // Seconds.
@@ -19,21 +98,102 @@ void ToneGeneratorInstrument<SampleType>::Generate(
   assert(sample_count >= 0);
   assert(samples);
 
-  for (int sample = 0; sample < sample_count; ++sample) {
-    int i = sample + sample_offset;
-    if (i < 0 || i >= static_cast<int>(length * sample_rate)) {
-      samples[sample] = 0;
-      continue;
+  int first, last;
+  AudibleSampleRange(static_cast<int>(length * sample_rate), sample_offset,
+                     sample_count, &first, &last);
+  std::fill(samples, samples + first, 0);
+  std::fill(samples + last, samples + sample_count, 0);
+
+  StoreSamples<SampleType> output(samples);
+  Synthesize(frequency, amplitude, sample_rate, sample_offset, first, last,
+             &output);
+}
+
+template <typename SampleType, typename AccumulatorType>
+void ToneGeneratorInstrument<SampleType, AccumulatorType>::MixVoices(
+    const VoiceBatch& voices,
+    int sample_rate,  // Samples / second.
+    AccumulatorType* accumulator) {
+  assert(sample_rate > 0);
+  assert(accumulator);
+
+  for (size_t voice = 0; voice < voices.size(); ++voice) {
+    assert(voices.frequencies[voice] >= 0);
+    assert(voices.amplitudes[voice] >= 0 && voices.amplitudes[voice] <= 1);
+    assert(voices.sample_counts[voice] >= 0);
+
+    // Silent samples contribute nothing to the mix, so only the audible range
+    // is synthesized.
+    int first, last;
+    AudibleSampleRange(voices.length_samples[voice],
+                       voices.sample_offsets[voice],
+                       voices.sample_counts[voice], &first, &last);
+    AccumulateSamples<SampleType, AccumulatorType> output(
+        accumulator + voices.accumulator_offsets[voice]);
+    Synthesize(voices.frequencies[voice], voices.amplitudes[voice],
+               sample_rate, voices.sample_offsets[voice], first, last,
+               &output);
+  }
+}
+
+template <typename SampleType, typename AccumulatorType>
+template <typename Output>
+void ToneGeneratorInstrument<SampleType, AccumulatorType>::Synthesize(
+    float frequency,
+    float amplitude,
+    int sample_rate,
+    int sample_offset,
+    int first,
+    int last,
+    Output* output) const {
+  static const SampleType kMax = std::numeric_limits<SampleType>::max();
+  static const SampleType kMin = std::numeric_limits<SampleType>::min();
+  static const SampleType kMid = static_cast<SampleType>((kMax + kMin) / 2.0);
+  const double gain = amplitude * kMax / 2.0;
+
+  if (oscillator_ == REFERENCE) {
+    for (int sample = first; sample < last; ++sample) {
+      int i = sample + sample_offset;
+      (*output)(sample, static_cast<SampleType>(
+          kMid + gain * std::sin(TonePhase(frequency, sample_rate, i))));
     }
+    return;
+  }
 
-    static const SampleType kMax = std::numeric_limits<SampleType>::max();
-    static const SampleType kMin = std::numeric_limits<SampleType>::min();
-    static const SampleType kMid = static_cast<SampleType>((kMax + kMin) / 2.0);
-    samples[sample] = static_cast<SampleType>(
-        kMid + amplitude * kMax / 2.0 *
-        std::sin(2.0 * M_PI * float(i) / float(sample_rate) * frequency));
+  // Lane l of the phasor holds exp(j * phase(i + l)) and each step rotates all
+  // lanes by exp(j * phase(kPhasorLanes)).
+  const double step_phase = TonePhase(frequency, sample_rate, kPhasorLanes);
+  const double step_real = std::cos(step_phase);
+  const double step_imaginary = std::sin(step_phase);
+  for (int block = first; block < last; block += kPhasorReseedInterval) {
+    int block_end = std::min(last, block + kPhasorReseedInterval);
+    double real[kPhasorLanes];
+    double imaginary[kPhasorLanes];
+    for (int lane = 0; lane < kPhasorLanes; ++lane) {
+      double phase =
+          TonePhase(frequency, sample_rate, block + sample_offset + lane);
+      real[lane] = std::cos(phase);
+      imaginary[lane] = std::sin(phase);
+    }
+
+    int sample = block;
+    for (; sample + kPhasorLanes <= block_end; sample += kPhasorLanes) {
+      for (int lane = 0; lane < kPhasorLanes; ++lane) {
+        (*output)(sample + lane,
+                  static_cast<SampleType>(kMid + gain * imaginary[lane]));
+        double rotated_real =
+            real[lane] * step_real - imaginary[lane] * step_imaginary;
+        imaginary[lane] =
+            real[lane] * step_imaginary + imaginary[lane] * step_real;
+        real[lane] = rotated_real;
+      }
+    }
+    for (int lane = 0; sample < block_end; ++sample, ++lane) {
+      (*output)(sample, static_cast<SampleType>(kMid + gain * imaginary[lane]));
+    }
   }
 }
 
 // Explicity template instantiations of supported types.
-template class ToneGeneratorInstrument<int>;
+template class Instrument<int, long long>;
+template class ToneGeneratorInstrument<int, long long>;
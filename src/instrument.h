@@ -1,8 +1,57 @@
 #ifndef INSTRUMENT_H_
 #define INSTRUMENT_H_
 
-// Instrument defines the interface to a waveform / patch generator.
-template <typename SampleType>
+#include <stddef.h>
+#include <vector>
+
+// VoiceBatch describes a set of voices (note fragments) to be mixed into one
+// accumulator buffer, stored as parallel arrays. Voice v renders the samples
+// [sample_offsets[v], sample_offsets[v] + sample_counts[v]) of its note to the
+// accumulator starting at accumulator_offsets[v].
+struct VoiceBatch {
+  size_t size() const { return frequencies.size(); }
+
+  void Clear() {
+    frequencies.clear();
+    amplitudes.clear();
+    length_samples.clear();
+    sample_offsets.clear();
+    accumulator_offsets.clear();
+    sample_counts.clear();
+  }
+
+  // Reserve room for 'voice_count' voices, so that adding them does not
+  // allocate.
+  void Reserve(size_t voice_count) {
+    frequencies.reserve(voice_count);
+    amplitudes.reserve(voice_count);
+    length_samples.reserve(voice_count);
+    sample_offsets.reserve(voice_count);
+    accumulator_offsets.reserve(voice_count);
+    sample_counts.reserve(voice_count);
+  }
+
+  void Add(float frequency, float amplitude, int note_length_samples,
+           int sample_offset, int accumulator_offset, int sample_count) {
+    frequencies.push_back(frequency);
+    amplitudes.push_back(amplitude);
+    length_samples.push_back(note_length_samples);
+    sample_offsets.push_back(sample_offset);
+    accumulator_offsets.push_back(accumulator_offset);
+    sample_counts.push_back(sample_count);
+  }
+
+  std::vector<float> frequencies;  // Hz.
+  std::vector<float> amplitudes;   // [0-1].
+  std::vector<int> length_samples;  // Samples in the whole note.
+  std::vector<int> sample_offsets;
+  std::vector<int> accumulator_offsets;
+  std::vector<int> sample_counts;
+};
+
+// Instrument defines the interface to a waveform / patch generator. Instances
+// may keep scratch state and are not thread-safe.
+template <typename SampleType, typename AccumulatorType>
 class Instrument {
  public:
   virtual ~Instrument() {}
@@ -14,12 +63,38 @@ class Instrument {
                         int sample_offset,
                         int sample_count,
                         SampleType* samples) = 0;
+
+  // Render a batch of voices, adding them into 'accumulator'. Each sample is
+  // identical to the one Generate() would produce. The default implementation
+  // calls Generate() for each voice and adds the result in a second pass;
+  // instruments should override it to synthesize straight into the
+  // accumulator.
+  virtual void MixVoices(const VoiceBatch& voices,
+                         int sample_rate,  // Samples / second.
+                         AccumulatorType* accumulator);
+
+ private:
+  std::vector<SampleType> sample_buffer_;
 };
 
 // Tone generator "reference" instrument implementation.
-template <typename SampleType>
-class ToneGeneratorInstrument : public Instrument<SampleType> {
+template <typename SampleType, typename AccumulatorType>
+class ToneGeneratorInstrument : public Instrument<SampleType, AccumulatorType> {
  public:
+  enum Oscillator {
+    // Evaluates std::sin for every sample.
+    REFERENCE,
+    // Rotates complex phasors from sample to sample, several samples at a
+    // time. The phasors are re-seeded from the exact phase at a fixed interval
+    // so that rounding errors can't accumulate. Output stays within a few units
+    // of the reference oscillator, plus the rounding of the phase itself,
+    // which grows along the note: to ~2000 units (relative 1e-6) two billion
+    // samples into a 10 kHz note. See instrument_test.
+    PHASOR,
+  };
+
+  explicit ToneGeneratorInstrument(Oscillator oscillator = PHASOR)
+      : oscillator_(oscillator) {}
   virtual ~ToneGeneratorInstrument() {}
 
   virtual void Generate(float frequency,  // Hz.
@@ -29,6 +104,24 @@ class ToneGeneratorInstrument : public Instrument<SampleType> {
                         int sample_offset,
                         int sample_count,
                         SampleType* samples);
+
+  virtual void MixVoices(const VoiceBatch& voices,
+                         int sample_rate,  // Samples / second.
+                         AccumulatorType* accumulator);
+
+ private:
+  // Synthesize the samples [first, last) of a voice, handing each to 'output'
+  // along with its index.
+  template <typename Output>
+  void Synthesize(float frequency,
+                  float amplitude,
+                  int sample_rate,
+                  int sample_offset,
+                  int first,
+                  int last,
+                  Output* output) const;
+
+  Oscillator oscillator_;
 };
 
 #endif  // INSTRUMENT_H_
@@ -0,0 +1,64 @@
+#include <float.h>
+#include <limits.h>
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+
+#include "instrument.h"
+
+using namespace std;
+
+typedef ToneGeneratorInstrument<int, long long> ToneGenerator;
+
+const int kSampleRate = 22000;
+
+// Samples compared at each offset into a note, covering several re-seedings of
+// the phasors.
+const int kSampleCount = 4096;
+
+// Checks that the PHASOR oscillator follows the REFERENCE one over notes as
+// long as a VoiceBatch allows, at audible frequencies. The two may differ by a
+// few units, plus the rounding of the phase, which grows with the phase and so
+// with the offset into the note.
+int main() {
+  const int kOffsets[] = {
+    0, 255, 1000000, 1 << 24, (1 << 24) + 1, 40000000, 200000000,
+    1000000007, 2140000000,
+  };
+  const float kFrequencies[] = { 27.5f, 440.0f, 4186.0f, 10000.0f };
+  // A second short of INT_MAX samples, which the float length may not exceed.
+  const float kLength = INT_MAX / kSampleRate - 1;
+  const double kGain = INT_MAX / 2.0;
+  ToneGenerator reference(ToneGenerator::REFERENCE);
+  ToneGenerator phasor(ToneGenerator::PHASOR);
+  vector<int> reference_samples(kSampleCount);
+  vector<int> phasor_samples(kSampleCount);
+  for (size_t offset = 0; offset < sizeof(kOffsets) / sizeof(kOffsets[0]);
+       ++offset) {
+    for (size_t frequency = 0;
+         frequency < sizeof(kFrequencies) / sizeof(kFrequencies[0]);
+         ++frequency) {
+      reference.Generate(kFrequencies[frequency], 1.0f, kLength, kSampleRate,
+                         kOffsets[offset], kSampleCount,
+                         &reference_samples[0]);
+      phasor.Generate(kFrequencies[frequency], 1.0f, kLength, kSampleRate,
+                      kOffsets[offset], kSampleCount, &phasor_samples[0]);
+      double max_phase = 2.0 * M_PI * kFrequencies[frequency] *
+          (static_cast<double>(kOffsets[offset]) + kSampleCount) /
+          kSampleRate;
+      double tolerance = 2.0 + 4.0 * DBL_EPSILON * max_phase * kGain;
+      double max_error = 0.0;
+      for (int sample = 0; sample < kSampleCount; ++sample) {
+        max_error = max(max_error, fabs(static_cast<double>(
+            phasor_samples[sample]) - reference_samples[sample]));
+      }
+      printf("%10d samples in, %7.1f Hz: off by %6.0f, up to %6.0f.\n",
+             kOffsets[offset], kFrequencies[frequency], max_error, tolerance);
+      if (max_error > tolerance) {
+        fprintf(stderr, "The phasor oscillator strays from the reference.\n");
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -1,98 +1,275 @@
+#include <getopt.h>
 #include <jack/jack.h>
 #include <jack/midiport.h>
+#include <jack/ringbuffer.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <set>
+#include <unistd.h>
+#include <algorithm>
 
+#include "callback_profiler.h"
 #include "fft.h"
 #include "midi.h"
+#include "pitch_modulator.h"
+
+typedef PitchModulator<float> Modulator;
+
+// Log messages buffered between the process callback and the main thread, and
+// how often the main thread prints them.
+const size_t kLogMessageCount = 1024;
+const useconds_t kLogPeriodMicroseconds = 100000;
+
+// Callbacks profiled between two collections of the profiler, 100 ms apart.
+const size_t kProfileRecordCount = 4096;
 
 jack_port_t* input_port_midi = NULL;
 jack_port_t* input_port_audio = NULL;
 jack_port_t* output_port_audio = NULL;
 
-std::set<double> active_notes;
+// Created with all its buffers and plans before the process callback may run.
+Modulator* modulator = NULL;
+
+// Times the process callback if profiling, or NULL.
+CallbackProfiler* profiler = NULL;
+
+// The process callback may not block on stdio, so its messages are passed to
+// the main thread through a lock-free ring buffer, and printed there.
+struct LogMessage {
+  enum Type {
+    NEW_TARGET,  // New target frequency 'to'.
+    SHIFT,       // Shift from dominant frequency 'from' to target 'to'.
+  } type;
+  double from;
+  double to;
+  int voice_count;  // Of a SHIFT, when harmonizing.
+  int dropped_count;  // Messages dropped before this one, the buffer full.
+};
+
+jack_ringbuffer_t* log_messages = NULL;
+int dropped_log_messages = 0;  // Only used by the process callback.
+
+// Queue a message from the process callback, without blocking.
+void Log(LogMessage::Type type, double from, double to, int voice_count) {
+  if (jack_ringbuffer_write_space(log_messages) < sizeof(LogMessage)) {
+    ++dropped_log_messages;
+    return;
+  }
+  LogMessage message;
+  message.type = type;
+  message.from = from;
+  message.to = to;
+  message.voice_count = voice_count;
+  message.dropped_count = dropped_log_messages;
+  jack_ringbuffer_write(log_messages, reinterpret_cast<const char*>(&message),
+                        sizeof(message));
+  dropped_log_messages = 0;
+}
+
+// Print the queued messages, from the main thread.
+void PrintLogMessages() {
+  LogMessage message;
+  while (jack_ringbuffer_read_space(log_messages) >= sizeof(message)) {
+    jack_ringbuffer_read(log_messages, reinterpret_cast<char*>(&message),
+                         sizeof(message));
+    if (message.dropped_count > 0) {
+      printf("(%d messages dropped)\n", message.dropped_count);
+    }
+    if (message.type == LogMessage::NEW_TARGET) {
+      printf("New frequency target: %f\n", message.to);
+    } else if (message.voice_count > 1) {
+      printf("%f -> %f and %d more voices\n", message.from, message.to,
+             message.voice_count - 1);
+    } else {
+      printf("%f -> %f\n", message.from, message.to);
+    }
+  }
+  fflush(stdout);
+}
 
-int process_midi(jack_nframes_t nframes, void* args) {
+// Hold and release notes on the MIDI events of the period.
+void ProcessMidi(jack_nframes_t nframes) {
   void* midi_port_buffer = jack_port_get_buffer(input_port_midi, nframes);
   jack_nframes_t midi_event_count = jack_midi_get_event_count(midi_port_buffer);
-  for (size_t midi_event = 0; midi_event < midi_event_count; ++midi_event) {
+  for (size_t event = 0; event < midi_event_count; ++event) {
     jack_midi_event_t jack_midi_event;
-    jack_midi_event_get(&jack_midi_event, midi_port_buffer, midi_event);
+    jack_midi_event_get(&jack_midi_event, midi_port_buffer, event);
 
+    // Longer events, such as system exclusive ones, are not interpreted.
     MIDI::RawEvent raw_midi_event;
     raw_midi_event.time = jack_midi_event.time;
-    raw_midi_event.size = jack_midi_event.size;
+    raw_midi_event.size = std::min(jack_midi_event.size,
+                                   sizeof(raw_midi_event.data));
+    memset(&raw_midi_event.data, 0, sizeof(raw_midi_event.data));
     memcpy(&raw_midi_event.data, jack_midi_event.buffer, raw_midi_event.size);
 
     MIDI::Event midi_event;
     MIDI::InterpretRawEvent(raw_midi_event, &midi_event);
-    if (midi_event.type == MIDI::Event::RESET) {
-      active_notes.clear();
-    }
+    modulator->HandleEvent(midi_event);
     if (midi_event.type == MIDI::Event::NOTE_ON) {
-      active_notes.insert(midi_event.real_value);
-      printf("New frequency target: %f\n", midi_event.real_value);
-    }
-    if (midi_event.type == MIDI::Event::NOTE_OFF) {
-      active_notes.erase(midi_event.real_value);
+      Log(LogMessage::NEW_TARGET, 0.0, midi_event.real_value, 0);
     }
   }
-  return 0;
 }
 
-int process_audio(jack_nframes_t nframes, void* args) {
+// The process callback handles the MIDI events of a period before its audio,
+// so that both are seen by a single thread. It neither allocates, locks nor
+// does I/O.
+int process(jack_nframes_t nframes, void* args) {
+  int64_t start = profiler != NULL ? profiler->Mark() : 0;
+  ProcessMidi(nframes);
+  if (profiler != NULL) {
+    profiler->AddStage(CallbackProfiler::MIDI, start);
+  }
+
   jack_default_audio_sample_t* input_audio =
       (jack_default_audio_sample_t*)jack_port_get_buffer(input_port_audio, nframes);
   jack_default_audio_sample_t* output_audio =
       (jack_default_audio_sample_t*)jack_port_get_buffer(output_port_audio, nframes);
-  FFT::FFTDecomposition fft_decomposition;
-  FFT::FFTDecompose(nframes, input_audio, &fft_decomposition);
-
-  double target_frequency = 440.0;
-  if (active_notes.size() > 0) {
-    target_frequency = *active_notes.begin();
+  if (modulator->Process(input_audio, nframes, output_audio) > 0 &&
+      modulator->dominant_frequency() > 0.0) {
+    Log(LogMessage::SHIFT, modulator->dominant_frequency(),
+        modulator->target_frequency(), modulator->voice_count());
   }
-  double dominant_frequency = 0.0;
-  if (FFT::FindDominantFrequency(fft_decomposition, 48000, &dominant_frequency)) {
-    FFT::PitchShift(48000, dominant_frequency, target_frequency, &fft_decomposition);
-    printf("%f -> %f\n", dominant_frequency, target_frequency);
+  if (profiler != NULL) {
+    profiler->EndCallback(start, static_cast<int64_t>(nframes) * 1000000000 /
+                          modulator->sample_rate());
   }
+  return 0;
+}
 
-  FFT::FFTRecompose(fft_decomposition, output_audio);
+int set_sample_rate(jack_nframes_t nframes, void* args) {
+  modulator->set_sample_rate(nframes);
   return 0;
 }
 
+// Report the latency of the modulator on top of that of the ports feeding the
+// input, or fed by the output.
+void report_latency(jack_latency_callback_mode_t mode, void* args) {
+  jack_latency_range_t range;
+  jack_nframes_t latency = modulator->latency();
+  if (mode == JackCaptureLatency) {
+    jack_port_get_latency_range(input_port_audio, mode, &range);
+    range.min += latency;
+    range.max += latency;
+    jack_port_set_latency_range(output_port_audio, mode, &range);
+  } else {
+    jack_port_get_latency_range(output_port_audio, mode, &range);
+    range.min += latency;
+    range.max += latency;
+    jack_port_set_latency_range(input_port_audio, mode, &range);
+  }
+}
+
 // This is the shutdown callback for this JACK application. It is called by JACK
 // if the server ever shuts down or decides to disconnect the client.
 void jack_shutdown(void *arg) {
   exit(1);
 }
 
+void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [-w window_size] [-o overlap] [-v voices]\n"
+          "       [-s seconds [-S stats_file]] [wisdom_file]\n"
+          "  The input is analyzed and shifted in frames of window_size "
+          "samples (default\n  %d), overlapping overlap times (default %d, "
+          "at least 4), whatever the JACK\n  period. The output lags by "
+          "window_size samples, as reported to JACK.\n"
+          "  With -v, the input is harmonized to up to voices of the lowest "
+          "notes held.\n"
+          "  With -s, the stages of the process callback are timed, and "
+          "their histograms\n  against the period deadline are printed "
+          "every given seconds, appended to\n  stats_file if given.\n"
+          "  FFTW wisdom is loaded from and saved to wisdom_file, if given, "
+          "so that later\n  runs start without measuring FFT plans.\n",
+          program, int(Modulator::kDefaultWindowSize),
+          int(Modulator::kDefaultOverlap));
+}
+
 int main(int argc, char** argv) {
-  if (argc != 1) {
-    fprintf(stderr, "Usage: jack_pitch_modulator\n");
+  int window_size = Modulator::kDefaultWindowSize;
+  int overlap = Modulator::kDefaultOverlap;
+  int voice_count = 1;
+  double profile_seconds = 0.0;
+  const char* stats_path = NULL;
+  int option;
+  while ((option = getopt(argc, argv, "w:o:v:s:S:")) != -1) {
+    switch (option) {
+      case 'w':
+        window_size = atoi(optarg);
+        break;
+      case 'o':
+        overlap = atoi(optarg);
+        break;
+      case 'v':
+        voice_count = atoi(optarg);
+        break;
+      case 's':
+        profile_seconds = atof(optarg);
+        break;
+      case 'S':
+        stats_path = optarg;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind > 1 || window_size <= 0 || overlap < 4 ||
+      window_size % overlap != 0 || voice_count < 1 ||
+      voice_count > int(Modulator::kMaxActiveNotes) || profile_seconds < 0.0 ||
+      (stats_path != NULL && profile_seconds == 0.0)) {
+    PrintUsage(argv[0]);
     return 1;
   }
 
-  jack_client_t *client = jack_client_new("jack_pitch_modulator");
-  jack_client_t *controller_client = jack_client_new("jack_pitch_modulator_controller");
-  if (client == NULL || controller_client == NULL) {
-    fprintf(stderr, "Could not create the Jack clients. Ensure that the Jack "
+  const char* wisdom_path = optind < argc ? argv[optind] : NULL;
+  if (wisdom_path != NULL && !FFT<float>::ImportWisdom(wisdom_path)) {
+    printf("No FFTW wisdom loaded from %s.\n", wisdom_path);
+  }
+
+  jack_client_t *client =
+      jack_client_open("jack_pitch_modulator", JackNullOption, NULL);
+  if (client == NULL) {
+    fprintf(stderr, "Could not create the Jack client. Ensure that the Jack "
             "server is running.\n");
     return 1;
   }
 
-  jack_set_process_callback(client, process_audio, NULL);
-  jack_set_process_callback(controller_client, process_midi, NULL);
-  jack_on_shutdown(client, jack_shutdown, NULL);
-  jack_on_shutdown(controller_client, jack_shutdown, NULL);
+  int sample_rate = jack_get_sample_rate(client);
+  printf("Engine sample rate: %d\n", sample_rate);
+  printf("Window of %d samples, hop of %d samples, latency of %.1f ms.\n",
+         window_size, window_size / overlap,
+         1000.0 * window_size / sample_rate);
+
+  // Buffers and plans are created before the process callback may run.
+  log_messages = jack_ringbuffer_create(kLogMessageCount * sizeof(LogMessage));
+  jack_ringbuffer_mlock(log_messages);
+  modulator = new Modulator(window_size, window_size / overlap, sample_rate,
+                            voice_count);
+  if (wisdom_path != NULL && !FFT<float>::ExportWisdom(wisdom_path)) {
+    fprintf(stderr, "Cannot save FFTW wisdom to %s.\n", wisdom_path);
+  }
+  if (profile_seconds > 0.0) {
+    FILE* stats_file = stats_path != NULL ? fopen(stats_path, "a") : stdout;
+    if (stats_file == NULL) {
+      fprintf(stderr, "Cannot open %s.\n", stats_path);
+      return 1;
+    }
+    profiler = new CallbackProfiler(kProfileRecordCount);
+    modulator->set_profiler(profiler);
+    if (!profiler->Start(stats_file, profile_seconds)) {
+      fprintf(stderr, "Cannot start the profiler thread.\n");
+      return 1;
+    }
+  }
 
-  printf("Engine sample rate: %d\n", int(jack_get_sample_rate(client)));
+  jack_set_process_callback(client, process, NULL);
+  jack_set_sample_rate_callback(client, set_sample_rate, NULL);
+  jack_set_latency_callback(client, report_latency, NULL);
+  jack_on_shutdown(client, jack_shutdown, NULL);
 
   input_port_midi = jack_port_register(
-      controller_client, "input_midi", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+      client, "input_midi", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
   input_port_audio = jack_port_register(
       client, "input_audio", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
   output_port_audio = jack_port_register(
@@ -102,13 +279,10 @@ int main(int argc, char** argv) {
     fprintf(stderr, "Cannot activate client");
     return 1;
   }
-  if (jack_activate(controller_client)) {
-    fprintf(stderr, "Cannot activate controller client");
-    return 1;
-  }
 
   while (true) {
-    sleep(1);
+    PrintLogMessages();
+    usleep(kLogPeriodMicroseconds);
   }
   return 0;
 }
@@ -0,0 +1,205 @@
+#include <getopt.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "live_synthesizer.h"
+#include "midi.h"
+
+typedef LiveSynthesizer<int, long long> Synthesizer;
+
+// Samples synthesized at once, and converted to JACK's floating point samples.
+const size_t kBlockSize = 256;
+
+// Events handed to the synthesizer at once.
+const size_t kMaxBlockEvents = 256;
+
+// Callbacks profiled between two collections of the profiler, 100 ms apart.
+const size_t kProfileRecordCount = 4096;
+
+jack_port_t* input_port_midi = NULL;
+jack_port_t* output_port_audio = NULL;
+
+// Created with all its buffers before the process callback may run.
+Synthesizer* synthesizer = NULL;
+std::vector<int> block_samples(kBlockSize);
+MIDI::Event block_events[kMaxBlockEvents];
+uint32_t block_event_frames[kMaxBlockEvents];
+
+// Times the process callback if profiling, or NULL.
+CallbackProfiler* profiler = NULL;
+
+// Interpret a JACK MIDI event. Longer events, such as system exclusive ones,
+// are not interpreted.
+bool InterpretJackEvent(const jack_midi_event_t& jack_midi_event,
+                        MIDI::Event* midi_event) {
+  MIDI::RawEvent raw_midi_event;
+  raw_midi_event.time = jack_midi_event.time;
+  raw_midi_event.size = std::min(jack_midi_event.size,
+                                 sizeof(raw_midi_event.data));
+  memset(&raw_midi_event.data, 0, sizeof(raw_midi_event.data));
+  memcpy(&raw_midi_event.data, jack_midi_event.buffer, raw_midi_event.size);
+  return MIDI::InterpretRawEvent(raw_midi_event, midi_event);
+}
+
+// The process callback hands the synthesizer the period a block at a time,
+// with the MIDI events of the block, so that notes start and stop at the
+// frames of their events. It neither allocates, locks nor does I/O.
+int process(jack_nframes_t nframes, void* args) {
+  int64_t start = profiler != NULL ? profiler->Mark() : 0;
+  void* midi_port_buffer = jack_port_get_buffer(input_port_midi, nframes);
+  jack_default_audio_sample_t* output_audio =
+      (jack_default_audio_sample_t*)jack_port_get_buffer(output_port_audio,
+                                                         nframes);
+
+  jack_nframes_t midi_event_count = jack_midi_get_event_count(midi_port_buffer);
+  jack_nframes_t next_event = 0;
+  for (jack_nframes_t block_start = 0; block_start < nframes;
+       block_start += kBlockSize) {
+    jack_nframes_t block_end =
+        std::min<jack_nframes_t>(nframes, block_start + kBlockSize);
+    jack_nframes_t done = block_start;
+    size_t event_count = 0;
+    for (; next_event < midi_event_count; ++next_event) {
+      jack_midi_event_t jack_midi_event;
+      jack_midi_event_get(&jack_midi_event, midi_port_buffer, next_event);
+
+      // Events are in order of time, within the period. Events at the end of
+      // the period are handled after its last sample.
+      jack_nframes_t event_time = std::min(jack_midi_event.time, nframes);
+      if (event_time >= block_end && block_end < nframes) {
+        break;
+      }
+      MIDI::Event midi_event;
+      if (!InterpretJackEvent(jack_midi_event, &midi_event)) {
+        continue;
+      }
+      if (event_count == kMaxBlockEvents) {
+        synthesizer->Process(block_events, block_event_frames, event_count,
+                             event_time - done,
+                             &block_samples[done - block_start]);
+        done = event_time;
+        event_count = 0;
+      }
+      block_events[event_count] = midi_event;
+      block_event_frames[event_count++] = event_time - done;
+    }
+    synthesizer->Process(block_events, block_event_frames, event_count,
+                         block_end - done,
+                         &block_samples[done - block_start]);
+    for (jack_nframes_t sample = block_start; sample < block_end; ++sample) {
+      output_audio[sample] = block_samples[sample - block_start] *
+                             (1.0f / static_cast<float>(INT_MAX));
+    }
+  }
+  if (profiler != NULL) {
+    profiler->EndCallback(start, static_cast<int64_t>(nframes) * 1000000000 /
+                          synthesizer->sample_rate());
+  }
+  return 0;
+}
+
+int set_sample_rate(jack_nframes_t nframes, void* args) {
+  synthesizer->set_sample_rate(nframes);
+  return 0;
+}
+
+// This is the shutdown callback for this JACK application. It is called by JACK
+// if the server ever shuts down or decides to disconnect the client.
+void jack_shutdown(void *arg) {
+  exit(1);
+}
+
+void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [-v voices] [-s seconds [-S stats_file]]\n"
+          "  Plays the notes of the MIDI input with the tone generator of "
+          "maestro, on up to\n  voices notes at once (default %d), the "
+          "oldest note giving way to a new one.\n"
+          "  With -s, the stages of the process callback are timed, and "
+          "their histograms\n  against the period deadline are printed "
+          "every given seconds, appended to\n  stats_file if given.\n",
+          program, int(Synthesizer::kDefaultVoiceCount));
+}
+
+int main(int argc, char** argv) {
+  int voice_count = Synthesizer::kDefaultVoiceCount;
+  double profile_seconds = 0.0;
+  const char* stats_path = NULL;
+  int option;
+  while ((option = getopt(argc, argv, "v:s:S:")) != -1) {
+    switch (option) {
+      case 'v':
+        voice_count = atoi(optarg);
+        break;
+      case 's':
+        profile_seconds = atof(optarg);
+        break;
+      case 'S':
+        stats_path = optarg;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc || voice_count < 1 || profile_seconds < 0.0 ||
+      (stats_path != NULL && profile_seconds == 0.0)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  jack_client_t *client =
+      jack_client_open("jack_synthesizer", JackNullOption, NULL);
+  if (client == NULL) {
+    fprintf(stderr, "Could not create the Jack client. Ensure that the Jack "
+            "server is running.\n");
+    return 1;
+  }
+
+  int sample_rate = jack_get_sample_rate(client);
+  printf("Engine sample rate: %d\n", sample_rate);
+  printf("%d voices.\n", voice_count);
+
+  // Buffers are created before the process callback may run.
+  synthesizer = new Synthesizer(sample_rate, voice_count);
+  if (profile_seconds > 0.0) {
+    FILE* stats_file = stats_path != NULL ? fopen(stats_path, "a") : stdout;
+    if (stats_file == NULL) {
+      fprintf(stderr, "Cannot open %s.\n", stats_path);
+      return 1;
+    }
+    profiler = new CallbackProfiler(kProfileRecordCount);
+    synthesizer->set_profiler(profiler);
+    if (!profiler->Start(stats_file, profile_seconds)) {
+      fprintf(stderr, "Cannot start the profiler thread.\n");
+      return 1;
+    }
+  }
+
+  jack_set_process_callback(client, process, NULL);
+  jack_set_sample_rate_callback(client, set_sample_rate, NULL);
+  jack_on_shutdown(client, jack_shutdown, NULL);
+
+  input_port_midi = jack_port_register(
+      client, "input_midi", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+  output_port_audio = jack_port_register(
+      client, "output_audio", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+
+  if (jack_activate(client)) {
+    fprintf(stderr, "Cannot activate client");
+    return 1;
+  }
+
+  while (true) {
+    sleep(1);
+  }
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include "live_synthesizer.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <limits>
+
+#include "soft_clip.h"
+
+using namespace std;
+
+// Samples mixed at once. Longer renders are done a block at a time.
+const size_t kBlockSize = 256;
+
+// Amplitude of every note, as MIDI::Event carries no velocity.
+const float kNoteAmplitude = 0.5f;
+
+// The length of a held note, as seen by the instrument. Notes are cut after
+// this many samples, which is over 12 hours at 48 kHz, and their voices freed.
+const int kHeldNoteLength = numeric_limits<int>::max();
+
+template <typename SampleType, typename AccumulatorType>
+const size_t LiveSynthesizer<SampleType, AccumulatorType>::kDefaultVoiceCount;
+
+template <typename SampleType, typename AccumulatorType>
+LiveSynthesizer<SampleType, AccumulatorType>::LiveSynthesizer(
+    int sample_rate, size_t voice_count)
+    : sample_rate_(sample_rate), voices_(voice_count), position_(0),
+      stolen_voice_count_(0), accumulator_buffer_(kBlockSize),
+      profiler_(NULL) {
+  assert(sample_rate_ > 0);
+  assert(voice_count > 0);
+  voice_batch_.Reserve(voice_count);
+
+  // The first block initializes the function statics of the instrument and of
+  // the soft clipping, which would otherwise lock in the first Render().
+  vector<SampleType> samples(kBlockSize);
+  voice_batch_.Add(0.0f, 0.0f, kBlockSize, 0, 0, kBlockSize);
+  instrument_.MixVoices(voice_batch_, sample_rate_, &accumulator_buffer_[0]);
+  SoftClipSamples(&accumulator_buffer_[0], kBlockSize, &samples[0]);
+  Reset();
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::set_sample_rate(
+    int sample_rate) {
+  assert(sample_rate > 0);
+  sample_rate_ = sample_rate;
+}
+
+template <typename SampleType, typename AccumulatorType>
+size_t LiveSynthesizer<SampleType, AccumulatorType>::active_voice_count()
+    const {
+  size_t active_voice_count = 0;
+  for (size_t voice = 0; voice < voices_.size(); ++voice) {
+    active_voice_count += voices_[voice].active;
+  }
+  return active_voice_count;
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::HandleEvent(
+    const MIDI::Event& event) {
+  if (event.type == MIDI::Event::RESET) {
+    for (size_t voice = 0; voice < voices_.size(); ++voice) {
+      voices_[voice].active = false;
+    }
+  } else if (event.type == MIDI::Event::NOTE_ON) {
+    // A note played again restarts on its own voice.
+    Voice* voice = NULL;
+    for (size_t other = 0; other < voices_.size() && voice == NULL; ++other) {
+      if (voices_[other].active &&
+          voices_[other].frequency == event.real_value) {
+        voice = &voices_[other];
+      }
+    }
+    if (voice == NULL) {
+      voice = AllocateVoice();
+    }
+    voice->active = true;
+    voice->frequency = event.real_value;
+    voice->start = position_;
+  } else if (event.type == MIDI::Event::NOTE_OFF) {
+    for (size_t voice = 0; voice < voices_.size(); ++voice) {
+      if (voices_[voice].frequency == event.real_value) {
+        voices_[voice].active = false;
+      }
+    }
+  }
+}
+
+template <typename SampleType, typename AccumulatorType>
+typename LiveSynthesizer<SampleType, AccumulatorType>::Voice*
+LiveSynthesizer<SampleType, AccumulatorType>::AllocateVoice() {
+  Voice* oldest = &voices_[0];
+  for (size_t voice = 0; voice < voices_.size(); ++voice) {
+    if (!voices_[voice].active) {
+      return &voices_[voice];
+    }
+    if (voices_[voice].start < oldest->start) {
+      oldest = &voices_[voice];
+    }
+  }
+  ++stolen_voice_count_;
+  return oldest;
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::Render(
+    size_t sample_count, SampleType* samples) {
+  assert(samples != NULL || sample_count == 0);
+  for (size_t done = 0; done < sample_count; done += kBlockSize) {
+    RenderBlock(min(kBlockSize, sample_count - done), samples + done);
+  }
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::Process(
+    const MIDI::Event* events,
+    const uint32_t* frames,
+    size_t event_count,
+    size_t sample_count,
+    SampleType* samples) {
+  assert((events != NULL && frames != NULL) || event_count == 0);
+  assert(samples != NULL || sample_count == 0);
+  int64_t time = profiler_ != NULL ? profiler_->Mark() : 0;
+  size_t done = 0;
+  for (size_t event = 0; event < event_count; ++event) {
+    assert(event == 0 || frames[event - 1] <= frames[event]);
+    size_t frame = min<size_t>(frames[event], sample_count);
+    if (frame > done) {
+      Render(frame - done, samples + done);
+      done = frame;
+      if (profiler_ != NULL) {
+        time = profiler_->AddStage(CallbackProfiler::SYNTHESIS, time);
+      }
+    }
+    HandleEvent(events[event]);
+    if (profiler_ != NULL) {
+      time = profiler_->AddStage(CallbackProfiler::MIDI, time);
+    }
+  }
+  Render(sample_count - done, samples + done);
+  if (profiler_ != NULL) {
+    profiler_->AddStage(CallbackProfiler::SYNTHESIS, time);
+  }
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::RenderBlock(
+    size_t sample_count, SampleType* samples) {
+  assert(sample_count <= kBlockSize);
+
+  // Each active voice renders the block of its note from its position in it.
+  // A voice whose note has been cut is freed, so that its position still fits
+  // in an int.
+  voice_batch_.Clear();
+  for (size_t voice = 0; voice < voices_.size(); ++voice) {
+    if (!voices_[voice].active) {
+      continue;
+    }
+    int64_t offset = position_ - voices_[voice].start;
+    if (offset >= kHeldNoteLength) {
+      voices_[voice].active = false;
+      continue;
+    }
+    voice_batch_.Add(voices_[voice].frequency, kNoteAmplitude,
+                     kHeldNoteLength, static_cast<int>(offset), 0,
+                     static_cast<int>(sample_count));
+  }
+  fill(accumulator_buffer_.begin(), accumulator_buffer_.begin() + sample_count,
+       0);
+  instrument_.MixVoices(voice_batch_, sample_rate_, &accumulator_buffer_[0]);
+  SoftClipSamples(&accumulator_buffer_[0], sample_count, samples);
+  position_ += sample_count;
+}
+
+template <typename SampleType, typename AccumulatorType>
+void LiveSynthesizer<SampleType, AccumulatorType>::Reset() {
+  for (size_t voice = 0; voice < voices_.size(); ++voice) {
+    voices_[voice].active = false;
+    voices_[voice].frequency = 0.0;
+    voices_[voice].start = 0;
+  }
+  position_ = 0;
+}
+
+// Explicit template instantiations of supported types.
+template class LiveSynthesizer<int, long long>;
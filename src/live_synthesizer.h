@@ -0,0 +1,91 @@
+#ifndef LIVE_SYNTHESIZER_H_
+#define LIVE_SYNTHESIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "instrument.h"
+#include "midi.h"
+
+// LiveSynthesizer plays the tone generator instrument of the renderer from MIDI
+// events as they arrive, block by block. Each held note sounds on a voice of a
+// fixed pool. Once all voices sound, a new note takes over the voice of the
+// oldest one. The instrument has no release, so a note stops on its NOTE_OFF.
+//
+// Events take effect at the current position of the output. Process() renders
+// a period up to each of its events before handling it, so that notes start and
+// stop at the exact samples of their events. Voices are mixed into an
+// accumulator and soft clipped, as by Renderer. All buffers are created, and
+// the instrument and soft clipping are run once, by the constructor, so that
+// none of HandleEvent(), Render() and Process() allocate or lock. The
+// LiveSynthesizer interface is not thread-safe.
+//
+// This is the processing of jack_synthesizer, shared with its offline driver.
+template <typename SampleType, typename AccumulatorType>
+class LiveSynthesizer {
+ public:
+  static const size_t kDefaultVoiceCount = 16;
+
+  LiveSynthesizer(int sample_rate, size_t voice_count = kDefaultVoiceCount);
+
+  int sample_rate() const { return sample_rate_; }
+  void set_sample_rate(int sample_rate);
+
+  size_t voice_count() const { return voices_.size(); }
+  size_t active_voice_count() const;
+
+  // Notes which took over the voice of an older note, since construction.
+  int64_t stolen_voice_count() const { return stolen_voice_count_; }
+
+  // Start or stop notes on NOTE_ON, NOTE_OFF and RESET events, from the
+  // current position. Other events are ignored.
+  void HandleEvent(const MIDI::Event& event);
+
+  // Synthesize the next 'sample_count' samples into 'samples'.
+  void Render(size_t sample_count, SampleType* samples);
+
+  // Synthesize the next 'sample_count' samples into 'samples', handling each
+  // of the 'event_count' 'events' at its frame in 'frames', in samples from
+  // the start of 'samples'. Frames may not decrease. Events at or past
+  // 'sample_count' are handled after the last sample.
+  void Process(const MIDI::Event* events,
+               const uint32_t* frames,
+               size_t event_count,
+               size_t sample_count,
+               SampleType* samples);
+
+  // Stop all notes and restart from position 0.
+  void Reset();
+
+  // Time the handling of events and the synthesis of Process() into
+  // 'profiler', or nothing if NULL. The caller times the callback as a whole.
+  void set_profiler(CallbackProfiler* profiler) { profiler_ = profiler; }
+
+ private:
+  struct Voice {
+    bool active;
+    double frequency;  // Hz, the note played.
+    int64_t start;     // Position of the first sample of the note.
+  };
+
+  // A free voice, or else the voice of the oldest note.
+  Voice* AllocateVoice();
+
+  // Mix the active voices into 'samples', at most a block of them.
+  void RenderBlock(size_t sample_count, SampleType* samples);
+
+  int sample_rate_;
+  std::vector<Voice> voices_;
+  int64_t position_;  // Samples rendered.
+  int64_t stolen_voice_count_;
+
+  ToneGeneratorInstrument<SampleType, AccumulatorType> instrument_;
+  VoiceBatch voice_batch_;  // Reserved for all voices.
+  std::vector<AccumulatorType> accumulator_buffer_;  // A block.
+
+  CallbackProfiler* profiler_;
+};
+
+#endif  // LIVE_SYNTHESIZER_H_
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# maestro_client.py: Client for a render server started with
+# 'maestro --serve socket'. See render_server.h for the protocol.
+
+from __future__ import print_function
+
+import socket
+import sys
+
+
+USAGE = """Usage:
+  maestro_client.py socket render [-f format] output.wav input.mae
+  maestro_client.py socket render_text [-f format] output.wav < input.mae
+  maestro_client.py socket stats
+  maestro_client.py socket shutdown"""
+
+
+# Render (or render_text) results, times in milliseconds.
+class RenderResult:
+    def __init__(self, fields):
+        self.queue_depth = int(fields[0])
+        self.queued_ms = float(fields[1])
+        self.prepare_ms = float(fields[2])
+        self.render_ms = float(fields[3])
+        self.total_ms = float(fields[4])
+        self.cached = fields[5] == '1'
+
+
+class ServerError(Exception):
+    pass
+
+
+# Send a single request to the server and return its response line.
+def Request(socket_path, line, body = b''):
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        connection.connect(socket_path)
+        connection.sendall(line.encode('utf-8') + b'\n' + body)
+        response = b''
+        while not response.endswith(b'\n'):
+            data = connection.recv(4096)
+            if not data:
+                break
+            response += data
+    finally:
+        connection.close()
+    response = response.decode('utf-8').strip()
+    if not response or response.startswith('ERROR'):
+        raise ServerError(response[6:] or 'no response')
+    return response
+
+
+# Render the score at 'input_path', which the server must be able to read.
+def Render(socket_path, output_path, input_path, format = 'wav'):
+    response = Request(socket_path, 'RENDER %s %s %s' % (
+        format, output_path, input_path))
+    return RenderResult(response.split()[1:])
+
+
+# Render .mae text sent along with the request.
+def RenderText(socket_path, output_path, text, format = 'wav'):
+    if not isinstance(text, bytes):
+        text = text.encode('utf-8')
+    response = Request(socket_path, 'RENDER_TEXT %s %s %d' % (
+        format, output_path, len(text)), text)
+    return RenderResult(response.split()[1:])
+
+
+# Server statistics as a dictionary.
+def Stats(socket_path):
+    names = ['jobs', 'failed_jobs', 'queue_depth', 'cached_scores',
+             'cache_bytes', 'cache_hits', 'cache_misses']
+    fields = Request(socket_path, 'STATS').split()[1:]
+    return dict(zip(names, [int(field) for field in fields]))
+
+
+def Shutdown(socket_path):
+    Request(socket_path, 'SHUTDOWN')
+
+
+def PrintResult(result):
+    print('queue depth %d, queued %.3f ms, prepare %.3f ms%s, render %.3f ms, '
+          'total %.3f ms' % (result.queue_depth, result.queued_ms,
+                             result.prepare_ms,
+                             ' (cached)' if result.cached else '',
+                             result.render_ms, result.total_ms))
+
+
+def Main(arguments):
+    if len(arguments) < 2:
+        print(USAGE, file = sys.stderr)
+        return 1
+    socket_path, command, arguments = arguments[0], arguments[1], arguments[2:]
+    format = 'wav'
+    if len(arguments) >= 2 and arguments[0] == '-f':
+        format, arguments = arguments[1], arguments[2:]
+    try:
+        if command == 'render' and len(arguments) == 2:
+            PrintResult(Render(socket_path, arguments[0], arguments[1], format))
+        elif command == 'render_text' and len(arguments) == 1:
+            text = getattr(sys.stdin, 'buffer', sys.stdin).read()
+            PrintResult(RenderText(socket_path, arguments[0], text, format))
+        elif command == 'stats' and not arguments:
+            for name, value in sorted(Stats(socket_path).items()):
+                print('%s: %d' % (name, value))
+        elif command == 'shutdown' and not arguments:
+            Shutdown(socket_path)
+        else:
+            print(USAGE, file = sys.stderr)
+            return 1
+    except (ServerError, socket.error) as error:
+        print('Error: %s' % error, file = sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(Main(sys.argv[1:]))
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+# maestro_load_test.py: Load test for a render server started with
+# 'maestro --serve socket'. Sends render jobs for a set of random scores from
+# concurrent clients and reports throughput, latency percentiles and cache use.
+#
+# Usage:
+#   maestro_load_test.py socket [jobs] [clients] [distinct scores] [seconds]
+#
+# Scores are sent inline, rendered to raw files in a temporary directory and
+# repeated, so that most jobs hit the server's prepared score cache.
+
+from __future__ import print_function
+
+import os
+import random
+import shutil
+import sys
+import tempfile
+import threading
+import time
+
+import maestro_client
+
+
+# Random .mae text of roughly 'seconds' length, with a repeated named segment.
+def RandomScore(generator, seconds):
+    def RandomNotes(count):
+        return ' '.join('%.2f@%.2fx%.2f' % (generator.uniform(110, 880),
+                                            generator.uniform(0.1, 1),
+                                            generator.choice([0.25, 0.5, 1]))
+                        for i in range(count))
+
+    motif = '$motif = (%s) & (%s);' % (RandomNotes(4), RandomNotes(2))
+    body = []
+    length = 0.0
+    while length < seconds:
+        if generator.random() < 0.5:
+            body.append('$motif x %d' % generator.randint(1, 3))
+            length += 2
+        else:
+            body.append('(%s)' % RandomNotes(8))
+            length += 4
+    return motif + '\n' + '\n'.join(body) + '\n'
+
+
+def Percentile(sorted_values, fraction):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(fraction * len(sorted_values)))
+    return sorted_values[index]
+
+
+def Main(arguments):
+    if not arguments:
+        print('Usage: maestro_load_test.py socket [jobs] [clients] '
+              '[distinct scores] [seconds]', file = sys.stderr)
+        return 1
+    socket_path = arguments[0]
+    job_count = int(arguments[1]) if len(arguments) > 1 else 200
+    client_count = int(arguments[2]) if len(arguments) > 2 else 8
+    score_count = int(arguments[3]) if len(arguments) > 3 else 10
+    score_seconds = float(arguments[4]) if len(arguments) > 4 else 20
+
+    generator = random.Random(0)
+    scores = [RandomScore(generator, score_seconds) for i in range(score_count)]
+    jobs = [generator.randrange(score_count) for i in range(job_count)]
+    output_directory = tempfile.mkdtemp(prefix = 'maestro_load_test')
+
+    lock = threading.Lock()
+    latencies = []
+    results = []
+    errors = []
+
+    def Client(client):
+        while True:
+            with lock:
+                if not jobs:
+                    return
+                job = len(jobs)
+                score = jobs.pop()
+            output_path = os.path.join(output_directory, '%d.raw' % client)
+            start = time.time()
+            try:
+                result = maestro_client.RenderText(
+                    socket_path, output_path, scores[score], 'raw')
+            except (maestro_client.ServerError, EnvironmentError) as error:
+                with lock:
+                    errors.append('job %d: %s' % (job, error))
+                continue
+            with lock:
+                latencies.append((time.time() - start) * 1000)
+                results.append(result)
+
+    start = time.time()
+    clients = [threading.Thread(target = Client, args = (client,))
+               for client in range(client_count)]
+    for client in clients:
+        client.start()
+    for client in clients:
+        client.join()
+    elapsed = time.time() - start
+    shutil.rmtree(output_directory)
+
+    latencies.sort()
+    print('%d jobs (%d failed) from %d clients in %.2f s: %.1f jobs / s' % (
+        job_count, len(errors), client_count, elapsed, job_count / elapsed))
+    print('Latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f' % (
+        Percentile(latencies, 0.5), Percentile(latencies, 0.9),
+        Percentile(latencies, 0.99), Percentile(latencies, 1.0)))
+    if results:
+        for name in ['queued_ms', 'prepare_ms', 'render_ms']:
+            values = sorted(getattr(result, name) for result in results)
+            print('Server %s: p50 %.1f, p99 %.1f' % (
+                name, Percentile(values, 0.5), Percentile(values, 0.99)))
+        print('Max queue depth: %d, cached preparations: %d / %d' % (
+            max(result.queue_depth for result in results),
+            sum(result.cached for result in results), len(results)))
+    print('Server: %s' % ', '.join(
+        '%s %d' % item for item in sorted(
+            maestro_client.Stats(socket_path).items())))
+    for error in errors[:10]:
+        print(error, file = sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(Main(sys.argv[1:]))
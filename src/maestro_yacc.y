@@ -1,57 +1,115 @@
 /* maestro_yacc.y */
 
-%{
-#include <iostream>
+%code requires {
+#include "yystype.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+}
+
+%code {
+#include <cmath>
+#include <map>
+#include <sstream>
 #include <string>
 
-#include "yystype.h"
 #include "note.h"
 
-extern int yyerror(Segment<SampleType>* result, const char* message);
-extern int yylex(void);
-%}
+extern int yyerror(yyscan_t scanner, ParseState* state, const char* message);
+extern int yylex(YYSTYPE* lvalp, yyscan_t scanner);
+extern char* yyget_text(yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+}
 
-%parse-param {Segment<SampleType>* result}
+%define api.pure
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner}
+%parse-param {ParseState* state}
 
 %start	input
 
-%token  COMMENT
 %token  FLOAT_LITERAL
+%token  IDENTIFIER
 %token	START_RIFF
 %token	END_RIFF
 %token  AT
 %token  TIMES
 %token  UNION
+%token  DEFINE
+%token  END_DEFINITION
 
 %%
 
 input:		/* empty */
-                | input COMMENT { *result = Concatenate(*result, $1.segment); }
-                | input segment	{ *result = Concatenate(*result, Concatenate($1.segment, $2.segment)); }
+                | input segment	{
+                    state->consumer->Consume(state->segments[$2.segment]);
+                    state->ClearSegments();
+                  }
+                | input definition
 		;
 
-segment:	riff { $$.segment = $1.segment; }
-                | segment UNION riff { $$.segment = Union($1.segment, $3.segment); }
+definition:     IDENTIFIER DEFINE segment END_DEFINITION {
+                    state->named_segments[*$1.text] =
+                        state->segments[$3.segment].Instance();
+                    state->ClearSegments();
+                  }
+                ;
+
+segment:	term { $$.segment = $1.segment; }
+                | segment UNION term {
+                    state->segments[$1.segment].Union(state->segments[$3.segment]);
+                    $$.segment = $1.segment;
+                  }
 		;
 
+term:           riff { $$.segment = $1.segment; }
+                | IDENTIFIER {
+                    std::map<std::string, Segment<SampleType> >::const_iterator named =
+                        state->named_segments.find(*$1.text);
+                    if (named == state->named_segments.end()) {
+                      yyerror(scanner, state, "undefined segment");
+                      YYABORT;
+                    }
+                    $$.segment = state->AddSegment(named->second);
+                  }
+                | term TIMES FLOAT_LITERAL {
+                    if (!($3.value >= 1 && $3.value <= kMaxRepeatCount) ||
+                        $3.value != std::floor($3.value)) {
+                      std::ostringstream message;
+                      message << "repeat count must be an integer from 1 to "
+                              << kMaxRepeatCount;
+                      yyerror(scanner, state, message.str().c_str());
+                      YYABORT;
+                    }
+                    state->segments[$1.segment].Repeat(static_cast<int>($3.value));
+                    $$.segment = $1.segment;
+                  }
+                ;
+
 riff:           START_RIFF note_list END_RIFF  { $$.segment = $2.segment; }
                 ;
-note_list:      note_list note { $$.segment = Concatenate($1.segment, $2.segment); }
+note_list:      note_list note {
+                    state->segments[$1.segment].Concatenate(state->segments[$2.segment]);
+                    $$.segment = $1.segment;
+                  }
                 | note { $$.segment = $1.segment; }
                 ;
-note:           FLOAT_LITERAL { $$.segment = Note(1.0, $1.value, 1.0); }
-                | FLOAT_LITERAL AT FLOAT_LITERAL TIMES FLOAT_LITERAL { $$.segment = Note($3.value, $1.value, $5.value); }
+note:           FLOAT_LITERAL { $$.segment = state->AddSegment(Note(1.0, $1.value, 1.0)); }
+                | FLOAT_LITERAL AT FLOAT_LITERAL TIMES FLOAT_LITERAL {
+                    $$.segment = state->AddSegment(Note($3.value, $1.value, $5.value));
+                  }
                 ;
 
 %%
 
-int yyerror(Segment<SampleType>* result, const char* message) {
-  extern int yylineno;	// defined and maintained in lex.c
-  extern char *yytext;	// defined and maintained in lex.c
-
-  std::cerr << "ERROR: " << message << " at symbol \"" << yytext
-            << "\" on line " << yylineno << std::endl;
-  exit(1);
-
+int yyerror(yyscan_t scanner, ParseState* state, const char* message) {
+  if (state->error.empty()) {
+    std::ostringstream error;
+    error << "ERROR: " << message << " at symbol \"" << yyget_text(scanner)
+          << "\" on line " << yyget_lineno(scanner);
+    state->error = error.str();
+  }
   return -1;
 }
@@ -1,34 +1,277 @@
-#define YY_NO_UNPUT
-
 #include <assert.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sndfile.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <iostream>
 #include <string>
 
+#include "compiled_score.h"
+#include "parser.h"
+#include "render_server.h"
+#include "render_sink.h"
 #include "renderer.h"
 #include "segment.h"
+#include "segment_stream.h"
 #include "yystype.h"
 
-extern int yyparse(Segment<SampleType>*);
+// Number of parsed notes which may wait to be rendered when streaming.
+const size_t kMaxQueuedNotes = 1 << 16;
+
+// Default memory bound of the prepared score cache when serving.
+const int kDefaultCacheMegabytes = 256;
+
+// Default bound of the score text of a RENDER_TEXT request when serving.
+const int kDefaultTextMegabytes = 16;
 
 using namespace std;
 
+void PrintUsage(const char* program) {
+  cerr << "Usage: " << program
+       << " [-j threads] [-s] [-f wav|flac|raw|maec] [-o output]"
+       << " [input.mae|input.maec]\n"
+       << "  Raw output is headerless 16 bit PCM. An output of '-' streams to"
+       << " stdout.\n"
+       << "  The maec format is a compiled score, which renders without being"
+       << " parsed again.\n"
+       << "  -s renders while parsing, in memory bounded by the largest"
+       << " top-level segment\n"
+       << "  rather than by the score, synthesizing on a single thread.\n"
+       << "       " << program
+       << " --serve socket [-j workers] [-m cache_megabytes]"
+       << " [-t text_megabytes]\n"
+       << "  Renders jobs sent to a Unix socket, see render_server.h, keeping"
+       << " prepared\n"
+       << "  scores cached across jobs. Scores sent as text may be at most"
+       << " text_megabytes\n  (default " << kDefaultTextMegabytes << ").\n";
+}
+
+// A score file to be parsed into a SegmentStream, and the parse error if any.
+struct StreamParse {
+  int input_file;
+  SegmentStream<SampleType>* stream;
+  string error;
+};
+
+// Parse a StreamParse. Run on its own thread, so that the score is rendered
+// while it is parsed. A parse error fails the stream, which stops the render.
+void* ParseStream(void* stream_parse) {
+  StreamParse* parse = static_cast<StreamParse*>(stream_parse);
+  if (ParseScoreFile(parse->input_file, parse->stream, &parse->error)) {
+    parse->stream->Finish();
+  } else {
+    parse->stream->Fail();
+  }
+  return NULL;
+}
+
+bool HasSuffix(const string& text, const string& suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
 int main(int argc, char **argv) {
-  if ((argc > 1) && (freopen(argv[1], "r", stdin) == NULL)) {
-    cerr << argv[0] << ": File " << argv[1] << " cannot be opened.\n";
+  int thread_count = 1;
+  bool streaming = false;
+  string format = "wav";
+  string output_path;
+  string socket_path;
+  int cache_megabytes = kDefaultCacheMegabytes;
+  int text_megabytes = kDefaultTextMegabytes;
+  const struct option long_options[] = {
+    { "serve", required_argument, NULL, 'S' },
+    { NULL, 0, NULL, 0 }
+  };
+  int option;
+  while ((option = getopt_long(argc, argv, "j:sf:o:m:t:", long_options,
+                               NULL)) != -1) {
+    switch (option) {
+      case 'j':
+        thread_count = atoi(optarg);
+        if (thread_count < 1) {
+          PrintUsage(argv[0]);
+          exit(1);
+        }
+        break;
+      case 's':
+        streaming = true;
+        break;
+      case 'f':
+        format = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'S':
+        socket_path = optarg;
+        break;
+      case 'm':
+        cache_megabytes = atoi(optarg);
+        if (cache_megabytes < 0) {
+          PrintUsage(argv[0]);
+          exit(1);
+        }
+        break;
+      case 't':
+        text_megabytes = atoi(optarg);
+        if (text_megabytes < 1) {
+          PrintUsage(argv[0]);
+          exit(1);
+        }
+        break;
+      default:
+        PrintUsage(argv[0]);
+        exit(1);
+    }
+  }
+  if (!socket_path.empty()) {
+    // Each worker renders its jobs on a single thread.
+    RenderServer server(thread_count,
+                        static_cast<size_t>(cache_megabytes) << 20,
+                        static_cast<size_t>(text_megabytes) << 20);
+    cout << "Serving on [" << socket_path << "] with " << thread_count
+         << " worker(s)..." << endl;
+    if (!server.Serve(socket_path)) {
+      cerr << argv[0] << ": Socket " << socket_path
+           << " cannot be served on.\n";
+      exit(1);
+    }
+    return 0;
+  }
+  if (format != "wav" && format != "flac" && format != "raw" &&
+      format != "maec") {
+    PrintUsage(argv[0]);
+    exit(1);
+  }
+  if (output_path.empty()) {
+    output_path = format == "raw" ? "-" : "result." + format;
+  }
+  if (output_path == "-" && format != "raw") {
+    cerr << argv[0] << ": Only raw output may be streamed to stdout.\n";
+    exit(1);
+  }
+  if (streaming && format == "maec") {
+    cerr << argv[0] << ": Scores cannot be compiled while streaming.\n";
     exit(1);
   }
 
-  //
-  cout << "Parsing [" << argv[1] << "]..." << endl;
+  // Status goes to stderr when the audio itself is streamed to stdout.
+  ostream& log = output_path == "-" ? cerr : cout;
+  Renderer<SampleType, AccumulatorType> renderer(thread_count);
+
+  // Compiled scores are mapped rather than parsed. When streaming, parsing only
+  // starts along with rendering.
+  const char* input_path = optind < argc ? argv[optind] : "<stdin>";
+  CompiledScore score;
   Segment<SampleType> segment;
-  assert(!yyparse(&segment));
+  int input_file = STDIN_FILENO;
+  bool compiled_input = HasSuffix(input_path, ".maec");
+  streaming = streaming && !compiled_input;
+  if (compiled_input) {
+    log << "Loading [" << input_path << "]..." << endl;
+    if (!score.Open(input_path)) {
+      cerr << argv[0] << ": File " << input_path
+           << " is not a readable compiled score.\n";
+      exit(1);
+    }
+    if (score.sample_rate() != renderer.sample_rate()) {
+      cerr << argv[0] << ": File " << input_path << " was compiled at "
+           << score.sample_rate() << " samples / second rather than "
+           << renderer.sample_rate() << ".\n";
+      exit(1);
+    }
+    if (format == "maec") {
+      cerr << argv[0] << ": File " << input_path
+           << " is already compiled.\n";
+      exit(1);
+    }
+  } else {
+    if (optind < argc) {
+      input_file = open(input_path, O_RDONLY);
+      if (input_file < 0) {
+        cerr << argv[0] << ": File " << input_path << " cannot be opened.\n";
+        exit(1);
+      }
+    }
+    if (!streaming) {
+      log << "Parsing [" << input_path << "]..." << endl;
+      SegmentCollector<SampleType> collector;
+      string error;
+      if (!ParseScoreFile(input_file, &collector, &error)) {
+        cerr << error << endl;
+        exit(1);
+      }
+      segment = collector.segment();
+    }
+  }
+
+  //
+  if (format == "maec") {
+    log << "Compiling [" << output_path << "]..." << endl;
+    const NoteTable& notes = segment.notes(renderer.sample_rate());
+    if (!CompiledScore::Write(output_path, notes.span(), notes.sample_rate(),
+                              notes.ToSamples(segment.length()))) {
+      cerr << argv[0] << ": Compiling to " << output_path << " failed.\n";
+      exit(1);
+    }
+    return 0;
+  }
 
   //
-  cout << "Rendering..." << endl;
-  Renderer<SampleType, AccumulatorType> renderer;
-  renderer.WriteWAV(segment, "result.wav");
+  if (streaming) {
+    log << "Parsing and rendering [" << input_path << "] to [" << output_path
+        << "]..." << endl;
+  } else {
+    log << "Rendering [" << output_path << "] with " << thread_count
+        << " thread(s)..." << endl;
+  }
+  RenderSink<SampleType>* sink = NULL;
+  int raw_file = STDOUT_FILENO;
+  if (format == "raw") {
+    if (output_path != "-") {
+      raw_file = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (raw_file < 0) {
+        cerr << argv[0] << ": File " << output_path << " cannot be opened.\n";
+        exit(1);
+      }
+    }
+    sink = new RawPCMSink<SampleType>(raw_file);
+  } else {
+    sink = new SoundFileSink<SampleType>(
+        output_path, format == "flac" ? SF_FORMAT_FLAC : SF_FORMAT_WAV);
+  }
+  BufferedSink<SampleType> buffered_sink(sink);
+  bool rendered = false;
+  if (streaming) {
+    SegmentStream<SampleType> stream(renderer.sample_rate(), kMaxQueuedNotes);
+    StreamParse parse = { input_file, &stream, string() };
+    pthread_t parser;
+    int error = pthread_create(&parser, NULL, ParseStream, &parse);
+    assert(!error);
+    rendered = renderer.RenderStream(&stream, &buffered_sink);
+    pthread_join(parser, NULL);
+    if (!parse.error.empty()) {
+      cerr << parse.error << endl;
+    }
+  } else if (compiled_input) {
+    rendered = renderer.Render(score, &buffered_sink);
+  } else {
+    rendered = renderer.Render(segment, &buffered_sink);
+  }
+  delete sink;
+  if (raw_file != STDOUT_FILENO) {
+    close(raw_file);
+  }
+  if (input_file != STDIN_FILENO) {
+    close(input_file);
+  }
+  if (!rendered) {
+    cerr << argv[0] << ": Rendering to " << output_path << " failed.\n";
+    exit(1);
+  }
 
   return 0;
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <fstream>
@@ -44,8 +45,23 @@ double NoteToFrequency(int midi_note) {
 
 enum EventType {
   SYSEX = 0xF0,
+  SYSEX_ESCAPE = 0xF7,
   META = 0xFF,
 };
+// Data bytes following the system common and real-time events other than SYSEX,
+// SYSEX_ESCAPE and META.
+size_t SystemEventDataSize(unsigned char event_type) {
+  switch (event_type) {
+    case 0xF1:  // MIDI time code quarter frame.
+    case 0xF3:  // Song select.
+      return 1;
+    case 0xF2:  // Song position pointer.
+      return 2;
+    default:
+      return 0;
+  }
+}
+
 enum MetaEventType {
   TEXT = 0x01,
   TRACK_NAME = 0x03,
@@ -58,6 +74,7 @@ enum ControllerEventType {
   NOTE_OFF = 0x80,
   NOTE_ON = 0x90,
   PROGRAM_CHANGE = 0xC0,
+  CHANNEL_PRESSURE = 0xD0,
   CONTROLLER = 0xB0,
   RESET	= 0xFF,
   HOLD_PEDAL = 64,
@@ -74,19 +91,22 @@ bool MIDI::InterpretRawEvent(const RawEvent& raw_event,
   event->type = Event::INVALID;
   event->time = 0.0;  // No point of reference.
 
+  // Events are taken from all channels. A note on without velocity is a note
+  // off.
+  unsigned char channel_event = raw_event.data[0] & 0xF0;
   if (raw_event.data[0] == RESET ||
-      (raw_event.data[0] == CONTROLLER && (raw_event.data[1] == ALL_NOTES_OFF ||
-                                           raw_event.data[1] == ALL_SOUND_OFF))) {
+      (channel_event == CONTROLLER && (raw_event.data[1] == ALL_NOTES_OFF ||
+                                       raw_event.data[1] == ALL_SOUND_OFF))) {
     event->type = Event::RESET;
     event->real_value = 0.0;
     return true;
   }
-  if (raw_event.data[0] == NOTE_ON) {
+  if (channel_event == NOTE_ON && raw_event.data[2] > 0) {
     event->type = Event::NOTE_ON;
     event->real_value = NoteToFrequency(raw_event.data[1]);
     return true;
   }
-  if (raw_event.data[0] == NOTE_OFF) {
+  if (channel_event == NOTE_OFF || channel_event == NOTE_ON) {
     event->type = Event::NOTE_OFF;
     event->real_value = NoteToFrequency(raw_event.data[1]);
     return true;
@@ -142,6 +162,9 @@ bool MIDI::ReadEventMap(const string& midi_path,
     ASSERT_EQ(MTrk, 0x4D54726B);
 
     size_t track_end = static_cast<size_t>(midi_file.tellg()) + track_size;
+    // Status of the last channel event, which later channel events of the same
+    // status may omit. 0 when cancelled by a system event.
+    byte running_status = 0;
     //int last_track_tempo_size = -1;
     //int last_track_event_size = -1;
     while (static_cast<size_t>(midi_file.tellg()) < track_end) {
@@ -160,13 +183,23 @@ bool MIDI::ReadEventMap(const string& midi_path,
       uint32 delta_time = ReadVariableLengthValue(&midi_file);
       byte event_type = ReadLE<byte>(&midi_file);
 
-      // SYSEX event.
-      if (event_type == SYSEX) {
+      // A data byte in place of the status byte is the first data byte of an
+      // event with the running status.
+      bool running = event_type < 0x80;
+      byte first_data = event_type;
+      if (running) {
+        event_type = running_status;
+      }
+
+      // SYSEX events.
+      if (event_type == SYSEX || event_type == SYSEX_ESCAPE) {
         uint32 event_size = ReadVariableLengthValue(&midi_file);
         midi_file.seekg(event_size, ios_base::cur);
+        running_status = 0;
       }
       // META events.
       else if (event_type == META) {
+        running_status = 0;
         byte meta_event_type = ReadLE<byte>(&midi_file);
         uint32 meta_event_size = ReadVariableLengthValue(&midi_file);
 
@@ -195,20 +228,29 @@ bool MIDI::ReadEventMap(const string& midi_path,
           midi_file.seekg(meta_event_size, ios_base::cur);
         }
       }
+      // Other system events.
+      else if (event_type > SYSEX) {
+        midi_file.seekg(SystemEventDataSize(event_type), ios_base::cur);
+        running_status = 0;
+      }
+      // A data byte without a running status is skipped.
+      else if (event_type < 0x80) {
+      }
       // MIDI control events.
       else {
-        byte control_event_type = (event_type & 0xF0) >> 4;
-        // All events of this type will be following by either one or two data
-        // bytes signified by the presence of the MSB.
-        byte data[2];
-        for (size_t n = 0; n < 5; ++n) {
-          data[n] = ReadLE<byte>(&midi_file);
-          if (!(data[n] & 0x80)) {
-            midi_file.unget();
-            break;
-          }
+        running_status = event_type;
+        byte control_event_type = event_type & 0xF0;
+        // Program changes and channel pressure are followed by one data byte,
+        // the other events of any channel by two.
+        byte data[2] = { 0, 0 };
+        size_t data_size = control_event_type == PROGRAM_CHANGE ||
+            control_event_type == CHANNEL_PRESSURE ? 1 : 2;
+        for (size_t n = 0; n < data_size; ++n) {
+          data[n] = running && n == 0 ? first_data : ReadLE<byte>(&midi_file);
         }
-	if (control_event_type == NOTE_OFF) {
+        // A note on without velocity is a note off.
+	if (control_event_type == NOTE_OFF ||
+            (control_event_type == NOTE_ON && data[1] == 0)) {
 	  track_events.push_back(
 	      Event(delta_time, Event::NOTE_OFF, NoteToFrequency(data[0])));
 	  track_event_added = true;
@@ -347,6 +389,30 @@ void MIDI::TimeTrackEvents(Track* track,
   }
 }
 
+bool EventTimeLess(const MIDI::Event& event_a, const MIDI::Event& event_b) {
+  return event_a.time < event_b.time;
+}
+
+bool MIDI::ReadNoteEvents(const string& midi_path, Track* events) {
+  assert(events != NULL);
+  EventMap event_map;
+  if (!ReadEventMap(midi_path, &event_map)) {
+    return false;
+  }
+  for (EventMap::const_iterator track = event_map.begin();
+       track != event_map.end(); ++track) {
+    for (size_t event = 0; event < track->second.size(); ++event) {
+      Event::Type type = track->second[event].type;
+      if (type == Event::NOTE_ON || type == Event::NOTE_OFF ||
+          type == Event::RESET) {
+        events->push_back(track->second[event]);
+      }
+    }
+  }
+  stable_sort(events->begin(), events->end(), EventTimeLess);
+  return true;
+}
+
 std::string MIDI::GuessLyricTrack(const EventMap& event_map) {
   assert(event_map.size() > 0);
 
@@ -47,6 +47,10 @@ class MIDI {
   static bool ReadEventMap(const std::string& midi_path,
 			   EventMap* event_map);
 
+  // ReadNoteEvents(...) reads the NOTE_ON, NOTE_OFF and RESET events of all
+  // tracks from the specified midi file path, merged in temporal order.
+  static bool ReadNoteEvents(const std::string& midi_path, Track* events);
+
   // GuessLyricTrack returns the name of the single track within the user
   // specified event map which has the most lyric events.
   static std::string GuessLyricTrack(const EventMap& event_map);
@@ -0,0 +1,59 @@
+#include "note_schedule.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// Heap ordering placing the note which ends first on top.
+struct EndsAfter {
+  EndsAfter(const int64_t* s, const int64_t* l)
+      : start_samples(s), length_samples(l) {}
+
+  bool operator()(size_t note_a, size_t note_b) const {
+    return start_samples[note_a] + length_samples[note_a] >
+           start_samples[note_b] + length_samples[note_b];
+  }
+
+  const int64_t* start_samples;
+  const int64_t* length_samples;
+};
+
+NoteSchedule::NoteSchedule(const int64_t* start_samples,
+                           const int64_t* length_samples,
+                           size_t note_count)
+    : start_samples_(start_samples), length_samples_(length_samples),
+      note_count_(note_count), next_note_(0) {
+  assert(note_count_ == 0 || start_samples_ != NULL);
+  assert(note_count_ == 0 || length_samples_ != NULL);
+  for (size_t note = 1; note < note_count_; ++note) {
+    assert(start_samples_[note - 1] <= start_samples_[note]);
+  }
+}
+
+void NoteSchedule::Advance(int64_t start, int64_t end,
+                           vector<size_t>* active_notes) {
+  assert(start <= end);
+  assert(active_notes != NULL);
+  EndsAfter ends_after(start_samples_, length_samples_);
+
+  // Notes which start before the end of the interval join the active heap...
+  for (; next_note_ < note_count_ && start_samples_[next_note_] < end;
+       ++next_note_) {
+    active_notes_.push_back(next_note_);
+    push_heap(active_notes_.begin(), active_notes_.end(), ends_after);
+  }
+
+  // ...and notes which stopped at or before its start leave it.
+  while (!active_notes_.empty() &&
+         start_samples_[active_notes_.front()] +
+         length_samples_[active_notes_.front()] <= start) {
+    pop_heap(active_notes_.begin(), active_notes_.end(), ends_after);
+    active_notes_.pop_back();
+  }
+
+  // Note indices follow onset order.
+  active_notes->assign(active_notes_.begin(), active_notes_.end());
+  sort(active_notes->begin(), active_notes->end());
+}
@@ -0,0 +1,35 @@
+#ifndef NOTE_SCHEDULE_H_
+#define NOTE_SCHEDULE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// NoteSchedule is a sweep-line index over a fixed set of timed events, such as
+// the rows of a NoteTable or a list of SegmentInstances. Events are given by
+// their onset and length columns, sorted by onset, and those which have started
+// sounding are kept in a heap ordered by end sample, so that advancing the
+// sweep line only touches the events which start or stop within the advanced
+// interval. The NoteSchedule interface is not thread-safe.
+class NoteSchedule {
+ public:
+  // The columns are referenced, not copied, and must outlive the schedule.
+  NoteSchedule(const int64_t* start_samples,
+               const int64_t* length_samples,
+               size_t note_count);
+
+  // Advance the sweep line to the sample interval [start, end) and fill
+  // 'active_notes' with the index of every note which overlaps it, in onset
+  // order. The intervals passed to successive calls must not move backwards in
+  // time.
+  void Advance(int64_t start, int64_t end, std::vector<size_t>* active_notes);
+
+ private:
+  const int64_t* start_samples_;
+  const int64_t* length_samples_;
+  size_t note_count_;
+  size_t next_note_;                 // First note which has not yet started.
+  std::vector<size_t> active_notes_;  // Heap, earliest end on top.
+};
+
+#endif  // NOTE_SCHEDULE_H_
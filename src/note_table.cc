@@ -0,0 +1,144 @@
+#include "note_table.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+// Bits of the onset sorted on by each radix sort pass.
+const int kRadixBits = 8;
+const int kRadixBuckets = 1 << kRadixBits;
+
+// Reorder 'column' so that entry i is the former entry order[i].
+template <typename T>
+void Gather(const vector<size_t>& order, vector<T>* column) {
+  vector<T> gathered(column->size());
+  for (size_t row = 0; row < order.size(); ++row) {
+    gathered[row] = (*column)[order[row]];
+  }
+  column->swap(gathered);
+}
+
+NoteTable::NoteTable(int sample_rate)
+    : sample_rate_(sample_rate) {
+  assert(sample_rate_ > 0);
+}
+
+int64_t NoteTable::ToSamples(double seconds) const {
+  return static_cast<int64_t>(floor(seconds * sample_rate_ + 0.5));
+}
+
+void NoteTable::Add(int64_t start_sample, int64_t length_samples,
+                    float frequency, float amplitude) {
+  assert(start_sample >= 0);
+  assert(length_samples >= 0);
+  start_samples_.push_back(start_sample);
+  length_samples_.push_back(length_samples);
+  frequencies_.push_back(frequency);
+  amplitudes_.push_back(amplitude);
+}
+
+void NoteTable::Append(const NoteSpan& notes) {
+  start_samples_.insert(start_samples_.end(), notes.start_samples,
+                        notes.start_samples + notes.size);
+  length_samples_.insert(length_samples_.end(), notes.length_samples,
+                         notes.length_samples + notes.size);
+  frequencies_.insert(frequencies_.end(), notes.frequencies,
+                      notes.frequencies + notes.size);
+  amplitudes_.insert(amplitudes_.end(), notes.amplitudes,
+                     notes.amplitudes + notes.size);
+}
+
+void NoteTable::Clear() {
+  start_samples_.clear();
+  length_samples_.clear();
+  frequencies_.clear();
+  amplitudes_.clear();
+}
+
+void NoteTable::RemoveEndedBy(int64_t sample) {
+  size_t kept = 0;
+  for (size_t row = 0; row < size(); ++row) {
+    if (start_samples_[row] + length_samples_[row] <= sample) {
+      continue;
+    }
+    start_samples_[kept] = start_samples_[row];
+    length_samples_[kept] = length_samples_[row];
+    frequencies_[kept] = frequencies_[row];
+    amplitudes_[kept] = amplitudes_[row];
+    ++kept;
+  }
+  start_samples_.resize(kept);
+  length_samples_.resize(kept);
+  frequencies_.resize(kept);
+  amplitudes_.resize(kept);
+}
+
+void NoteTable::SortByOnset() {
+  const size_t row_count = size();
+  int64_t last_onset = 0;
+  bool sorted = true;
+  for (size_t row = 0; row < row_count; ++row) {
+    if (row > 0 && start_samples_[row] < start_samples_[row - 1]) {
+      sorted = false;
+    }
+    last_onset = max(last_onset, start_samples_[row]);
+  }
+  if (sorted) {
+    return;
+  }
+
+  // Each pass distributes the (onset, row) pairs into buckets by one digit of
+  // the onset, preserving the order from the previous pass. The onsets travel
+  // along with the rows so that every pass reads memory sequentially.
+  vector<uint64_t> keys(start_samples_.begin(), start_samples_.end());
+  vector<size_t> order(row_count);
+  for (size_t row = 0; row < row_count; ++row) {
+    order[row] = row;
+  }
+  vector<uint64_t> sorted_keys(row_count);
+  vector<size_t> sorted_order(row_count);
+  const uint64_t max_key = static_cast<uint64_t>(last_onset);
+  for (int shift = 0; shift < 64 && (max_key >> shift) != 0;
+       shift += kRadixBits) {
+    size_t bucket_starts[kRadixBuckets] = { 0 };
+    for (size_t row = 0; row < row_count; ++row) {
+      ++bucket_starts[(keys[row] >> shift) & (kRadixBuckets - 1)];
+    }
+    size_t total = 0;
+    for (int bucket = 0; bucket < kRadixBuckets; ++bucket) {
+      size_t count = bucket_starts[bucket];
+      bucket_starts[bucket] = total;
+      total += count;
+    }
+    for (size_t row = 0; row < row_count; ++row) {
+      int bucket = (keys[row] >> shift) & (kRadixBuckets - 1);
+      size_t target = bucket_starts[bucket]++;
+      sorted_keys[target] = keys[row];
+      sorted_order[target] = order[row];
+    }
+    keys.swap(sorted_keys);
+    order.swap(sorted_order);
+  }
+
+  Gather(order, &start_samples_);
+  Gather(order, &length_samples_);
+  Gather(order, &frequencies_);
+  Gather(order, &amplitudes_);
+}
+
+NoteSpan NoteTable::span(size_t begin, size_t end) const {
+  assert(begin <= end && end <= size());
+  NoteSpan span;
+  if (begin == end) {
+    return span;
+  }
+  span.start_samples = &start_samples_[begin];
+  span.length_samples = &length_samples_[begin];
+  span.frequencies = &frequencies_[begin];
+  span.amplitudes = &amplitudes_[begin];
+  span.size = end - begin;
+  return span;
+}
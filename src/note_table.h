@@ -0,0 +1,63 @@
+#ifndef NOTE_TABLE_H_
+#define NOTE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// A read-only view of a run of consecutive NoteTable rows. Each column is a
+// contiguous array of 'size' entries.
+struct NoteSpan {
+  NoteSpan()
+      : start_samples(NULL), length_samples(NULL), frequencies(NULL),
+        amplitudes(NULL), size(0) {}
+
+  const int64_t* start_samples;
+  const int64_t* length_samples;
+  const float* frequencies;
+  const float* amplitudes;
+  size_t size;
+};
+
+// NoteTable stores flattened notes column by column, with their timing given
+// in whole samples at a fixed sample rate. Unlike float seconds, sample indices
+// stay exact however long the piece, and code sweeping over note onsets only
+// touches the onset column. The NoteTable interface is not thread-safe.
+class NoteTable {
+ public:
+  explicit NoteTable(int sample_rate);  // Samples / second.
+
+  int sample_rate() const { return sample_rate_; }
+  size_t size() const { return start_samples_.size(); }
+  bool empty() const { return start_samples_.empty(); }
+
+  // The nearest sample index to a time in seconds.
+  int64_t ToSamples(double seconds) const;
+
+  void Add(int64_t start_sample, int64_t length_samples,
+           float frequency, float amplitude);
+  void Append(const NoteSpan& notes);
+  void Clear();
+
+  // Remove the rows of notes which end at or before 'sample', keeping the
+  // order of the remaining rows.
+  void RemoveEndedBy(int64_t sample);
+
+  // Stable sort of the rows by start sample, so notes starting together keep
+  // their order of appearance. Uses a least significant digit radix sort, which
+  // only makes as many passes as the last onset needs digits.
+  void SortByOnset();
+
+  // All rows, or the rows [begin, end).
+  NoteSpan span() const { return span(0, size()); }
+  NoteSpan span(size_t begin, size_t end) const;
+
+ private:
+  int sample_rate_;
+  std::vector<int64_t> start_samples_;   // Samples from song start.
+  std::vector<int64_t> length_samples_;  // Samples.
+  std::vector<float> frequencies_;       // Hz.
+  std::vector<float> amplitudes_;        // [0-1].
+};
+
+#endif  // NOTE_TABLE_H_
@@ -0,0 +1,245 @@
+#include <getopt.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "midi.h"
+#include "pitch_modulator.h"
+#include "render_sink.h"
+#include "sound.h"
+
+using namespace std;
+
+typedef PitchModulator<float> Modulator;
+
+// Period sizes simulated by default, in samples.
+const char* kDefaultPeriodSizes = "64,128,256,512,1024";
+
+void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [-w window_size] [-o overlap] [-v voices]"
+          " [-p period_sizes] [-s]\n       input.wav output.wav "
+          "[notes.mid]\n"
+          "  Runs the processing of jack_pitch_modulator over a mono sound "
+          "file, without\n  JACK, as fast as it can, tuning it to the notes of "
+          "a MIDI file if given.\n  The input is processed once per period "
+          "size, a comma separated list\n  (default %s), and the time taken "
+          "by the periods is compared to their\n  real-time deadline. The "
+          "output of the first period size is written, lagging\n  by "
+          "window_size samples. -w, -o and -v are those of\n"
+          "  jack_pitch_modulator.\n"
+          "  With -s, the stages of the periods are profiled as by "
+          "jack_pitch_modulator -s,\n  and printed after each period size. "
+          "Comparing speeds with and without -s\n  measures the cost of "
+          "profiling.\n",
+          program, kDefaultPeriodSizes);
+}
+
+// Parse a comma separated list of positive period sizes.
+bool ParsePeriodSizes(const string& text, vector<size_t>* period_sizes) {
+  size_t begin = 0;
+  while (begin <= text.size()) {
+    size_t end = min(text.find(',', begin), text.size());
+    int period_size = atoi(text.substr(begin, end - begin).c_str());
+    if (period_size <= 0) {
+      return false;
+    }
+    period_sizes->push_back(period_size);
+    begin = end + 1;
+  }
+  return !period_sizes->empty();
+}
+
+// Seconds elapsed since 'start'.
+double ElapsedSeconds(const timespec& start) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + 1e-9 * (now.tv_nsec - start.tv_nsec);
+}
+
+// The value below which 'fraction' of the sorted 'values' lie.
+double Percentile(const vector<double>& values, double fraction) {
+  return values[min(values.size() - 1,
+                    static_cast<size_t>(fraction * values.size()))];
+}
+
+// Run a new modulator over 'input' in periods of 'period_size' samples, as the
+// JACK process callback would, into 'output'. The events due by the end of a
+// period are handled before it, as JACK hands them to the callback of the
+// period. The input is followed by the latency of the modulator in silence,
+// so that 'output' ends with the end of the input, delayed by the latency.
+// Prints the time taken by the periods, in microseconds, against their
+// deadline, and their profile if 'profile' is true.
+void SimulatePeriods(size_t period_size,
+                     size_t window_size,
+                     size_t hop_size,
+                     int sample_rate,
+                     size_t voice_count,
+                     bool profile,
+                     const vector<float>& input,
+                     const vector<MIDI::Event>& events,
+                     vector<float>* output) {
+  Modulator modulator(window_size, hop_size, sample_rate, voice_count);
+  // The ring holds every period, and is collected once they are all done.
+  size_t length = input.size() + modulator.latency();
+  CallbackProfiler profiler(length / period_size + 1);
+  if (profile) {
+    modulator.set_profiler(&profiler);
+  }
+  int64_t deadline_nanoseconds =
+      static_cast<int64_t>(period_size) * 1000000000 / sample_rate;
+  vector<float> input_period(period_size);
+  vector<float> output_period(period_size);
+  vector<double> period_times;
+  period_times.reserve(length / period_size + 1);
+  output->resize(length);
+
+  size_t next_event = 0;
+  for (size_t start = 0; start < length; start += period_size) {
+    size_t sample_count = min(period_size, length - start);
+    size_t input_count =
+        start < input.size() ? min(period_size, input.size() - start) : 0;
+    copy(input.begin() + start, input.begin() + start + input_count,
+         input_period.begin());
+    fill(input_period.begin() + input_count, input_period.end(), 0.0f);
+    double period_end =
+        static_cast<double>(start + period_size) / sample_rate;
+
+    timespec period_start;
+    clock_gettime(CLOCK_MONOTONIC, &period_start);
+    int64_t callback_start = profile ? profiler.Mark() : 0;
+    while (next_event < events.size() &&
+           events[next_event].time < period_end) {
+      modulator.HandleEvent(events[next_event++]);
+    }
+    if (profile) {
+      profiler.AddStage(CallbackProfiler::MIDI, callback_start);
+    }
+    modulator.Process(&input_period[0], period_size, &output_period[0]);
+    if (profile) {
+      profiler.EndCallback(callback_start, deadline_nanoseconds);
+    }
+    period_times.push_back(ElapsedSeconds(period_start));
+
+    copy(output_period.begin(), output_period.begin() + sample_count,
+         output->begin() + start);
+  }
+
+  double deadline = static_cast<double>(period_size) / sample_rate;
+  size_t late_count = 0;
+  double total_time = 0.0;
+  for (size_t period = 0; period < period_times.size(); ++period) {
+    late_count += period_times[period] > deadline;
+    total_time += period_times[period];
+  }
+  sort(period_times.begin(), period_times.end());
+  printf("%7d %8d %9.1f %9.1f %9.1f %9.1f %9.1f %7.3f%% %8.1fx\n",
+         int(period_size), int(period_times.size()), deadline * 1e6,
+         Percentile(period_times, 0.5) * 1e6,
+         Percentile(period_times, 0.99) * 1e6,
+         Percentile(period_times, 0.999) * 1e6, period_times.back() * 1e6,
+         100.0 * late_count / period_times.size(),
+         period_times.size() * deadline / total_time);
+  if (profile) {
+    profiler.Print(stdout);
+  }
+}
+
+int main(int argc, char** argv) {
+  int window_size = Modulator::kDefaultWindowSize;
+  int overlap = Modulator::kDefaultOverlap;
+  int voice_count = 1;
+  vector<size_t> period_sizes;
+  string period_list = kDefaultPeriodSizes;
+  bool profile = false;
+  int option;
+  while ((option = getopt(argc, argv, "w:o:v:p:s")) != -1) {
+    switch (option) {
+      case 'w':
+        window_size = atoi(optarg);
+        break;
+      case 'o':
+        overlap = atoi(optarg);
+        break;
+      case 'v':
+        voice_count = atoi(optarg);
+        break;
+      case 'p':
+        period_list = optarg;
+        break;
+      case 's':
+        profile = true;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind < 2 || argc - optind > 3 || window_size <= 0 ||
+      overlap < 4 || window_size % overlap != 0 || voice_count < 1 ||
+      voice_count > int(Modulator::kMaxActiveNotes) ||
+      !ParsePeriodSizes(period_list, &period_sizes)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  string input_path = argv[optind];
+  string output_path = argv[optind + 1];
+
+  size_t sample_rate = 0;
+  size_t sample_count = 0;
+  float* samples = NULL;
+  int channel_count =
+      Sound::ReadFromFile(input_path, &sample_rate, &sample_count, &samples);
+  if (samples == NULL || sample_count == 0) {
+    delete[] samples;
+    fprintf(stderr, "Cannot read samples from %s.\n", input_path.c_str());
+    return 1;
+  }
+  if (channel_count != 1) {
+    delete[] samples;
+    fprintf(stderr, "%s has %d channels; the modulator takes a mono voice.\n",
+            input_path.c_str(), channel_count);
+    return 1;
+  }
+  vector<float> input(samples, samples + sample_count);
+  delete[] samples;
+
+  vector<MIDI::Event> events;
+  if (argc - optind == 3 &&
+      !MIDI::ReadNoteEvents(argv[optind + 2], &events)) {
+    fprintf(stderr, "Cannot read MIDI events from %s.\n", argv[optind + 2]);
+    return 1;
+  }
+
+  printf("%d samples at %d Hz (%.1f s), %d note events. Window of %d "
+         "samples, hop of\n%d samples, latency of %.1f ms.\n",
+         int(sample_count), int(sample_rate),
+         static_cast<double>(sample_count) / sample_rate, int(events.size()),
+         window_size, window_size / overlap,
+         1000.0 * window_size / sample_rate);
+  printf("Period times, in microseconds:\n");
+  printf("%7s %8s %9s %9s %9s %9s %9s %8s %9s\n", "period", "periods",
+         "deadline", "median", "99%", "99.9%", "max", "late", "speed");
+  vector<float> output;
+  vector<float> period_output;
+  for (size_t period_size = 0; period_size < period_sizes.size();
+       ++period_size) {
+    SimulatePeriods(period_sizes[period_size], window_size,
+                    window_size / overlap, sample_rate, voice_count, profile,
+                    input, events,
+                    period_size == 0 ? &output : &period_output);
+  }
+
+  SoundFileSink<float> sink(output_path, SF_FORMAT_WAV);
+  if (!sink.Open(sample_rate) || !sink.Write(&output[0], output.size()) ||
+      !sink.Close()) {
+    fprintf(stderr, "Cannot write %s.\n", output_path.c_str());
+    return 1;
+  }
+  return 0;
+}
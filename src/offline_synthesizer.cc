@@ -0,0 +1,123 @@
+#include <getopt.h>
+#include <sndfile.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "live_synthesizer.h"
+#include "midi.h"
+#include "render_sink.h"
+
+using namespace std;
+
+typedef LiveSynthesizer<int, long long> Synthesizer;
+
+const int kDefaultSampleRate = 48000;
+const int kDefaultPeriodSize = 256;
+
+// Silence rendered after the last event.
+const double kTailSeconds = 1.0;
+
+void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [-v voices] [-p period_size] [-r sample_rate]"
+          " notes.mid output.wav\n"
+          "  Plays a MIDI file through the process callback of "
+          "jack_synthesizer, without\n  JACK, as fast as it can, in periods "
+          "of period_size samples (default %d) at\n  sample_rate (default "
+          "%d). The time taken by the periods is profiled against\n  their "
+          "real-time deadline, and the output is written. -v is that of\n"
+          "  jack_synthesizer.\n",
+          program, kDefaultPeriodSize, kDefaultSampleRate);
+}
+
+int main(int argc, char** argv) {
+  int voice_count = Synthesizer::kDefaultVoiceCount;
+  int period_size = kDefaultPeriodSize;
+  int sample_rate = kDefaultSampleRate;
+  int option;
+  while ((option = getopt(argc, argv, "v:p:r:")) != -1) {
+    switch (option) {
+      case 'v':
+        voice_count = atoi(optarg);
+        break;
+      case 'p':
+        period_size = atoi(optarg);
+        break;
+      case 'r':
+        sample_rate = atoi(optarg);
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+  if (argc - optind != 2 || voice_count < 1 || period_size <= 0 ||
+      sample_rate <= 0) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  string midi_path = argv[optind];
+  string output_path = argv[optind + 1];
+
+  MIDI::Track events;
+  if (!MIDI::ReadNoteEvents(midi_path, &events)) {
+    fprintf(stderr, "Cannot read MIDI events from %s.\n", midi_path.c_str());
+    return 1;
+  }
+  double length = (events.empty() ? 0.0 : events.back().time) + kTailSeconds;
+  size_t period_count =
+      static_cast<size_t>(ceil(length * sample_rate / period_size));
+  printf("%d note events, %d periods of %d samples at %d Hz (%.1f s), %d "
+         "voices.\n", int(events.size()), int(period_count), period_size,
+         sample_rate, static_cast<double>(period_count) * period_size /
+         sample_rate, voice_count);
+
+  // Events are due at the nearest sample.
+  vector<int64_t> event_samples(events.size());
+  for (size_t event = 0; event < events.size(); ++event) {
+    event_samples[event] =
+        static_cast<int64_t>(floor(events[event].time * sample_rate + 0.5));
+  }
+
+  // Each period is processed as by the process callback of jack_synthesizer,
+  // with the events due within it.
+  Synthesizer synthesizer(sample_rate, voice_count);
+  CallbackProfiler profiler(period_count);
+  synthesizer.set_profiler(&profiler);
+  int64_t deadline_nanoseconds =
+      static_cast<int64_t>(period_size) * 1000000000 / sample_rate;
+  vector<int> output(period_count * period_size);
+  vector<uint32_t> period_frames(events.size() + 1);
+  size_t next_event = 0;
+  for (size_t period = 0; period < period_count; ++period) {
+    int64_t period_start = static_cast<int64_t>(period) * period_size;
+    size_t first_event = next_event;
+    while (next_event < events.size() &&
+           event_samples[next_event] - period_start < period_size) {
+      period_frames[next_event - first_event] = static_cast<uint32_t>(
+          max<int64_t>(0, event_samples[next_event] - period_start));
+      ++next_event;
+    }
+    int64_t start = profiler.Mark();
+    synthesizer.Process(events.empty() ? NULL : &events[0] + first_event,
+                        &period_frames[0], next_event - first_event,
+                        period_size, &output[period_start]);
+    profiler.EndCallback(start, deadline_nanoseconds);
+  }
+  profiler.Print(stdout);
+  printf("%lld notes took over the voice of an older note.\n",
+         (long long)synthesizer.stolen_voice_count());
+
+  SoundFileSink<int> sink(output_path, SF_FORMAT_WAV);
+  if (!sink.Open(sample_rate) || !sink.Write(&output[0], output.size()) ||
+      !sink.Close()) {
+    fprintf(stderr, "Cannot write %s.\n", output_path.c_str());
+    return 1;
+  }
+  return 0;
+}
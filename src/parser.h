@@ -0,0 +1,30 @@
+#ifndef PARSER_H_
+#define PARSER_H_
+
+#include <string>
+
+#include "segment.h"
+#include "segment_stream.h"
+#include "yystype.h"
+
+// Entry points to the .mae parser. Parses are independent of each other, so
+// scores may be parsed concurrently from any number of threads. Each returns
+// false on errors, with a description of the first one in 'error'.
+
+// Parse a score held in memory, handing its top-level segments to 'consumer'
+// as they are parsed.
+bool ParseScore(const std::string& text,
+                SegmentConsumer<SampleType>* consumer,
+                std::string* error);
+
+// Parse a score read from the file descriptor 'file', which is left open.
+bool ParseScoreFile(int file,
+                    SegmentConsumer<SampleType>* consumer,
+                    std::string* error);
+
+// Parse a score held in memory into a single segment.
+bool ParseScore(const std::string& text,
+                Segment<SampleType>* score,
+                std::string* error);
+
+#endif  // PARSER_H_
@@ -0,0 +1,120 @@
+#include "pitch_modulator.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using namespace std;
+
+// The target frequency while no note is held.
+const double kDefaultTargetFrequency = 440.0;
+
+// Pitches followed by the tracker, of which the strongest is tuned. Weaker
+// ones leave it room to group the harmonics of the voice.
+const size_t kTrackedPitches = 4;
+
+template <typename Real>
+const size_t PitchModulator<Real>::kDefaultWindowSize;
+template <typename Real>
+const size_t PitchModulator<Real>::kDefaultOverlap;
+template <typename Real>
+const size_t PitchModulator<Real>::kMaxActiveNotes;
+
+template <typename Real>
+PitchModulator<Real>::PitchModulator(size_t window_size,
+                                     size_t hop_size,
+                                     int sample_rate,
+                                     size_t max_voices)
+    : sample_rate_(sample_rate), active_note_count_(0),
+      tracker_(window_size, sample_rate, kTrackedPitches), frame_count_(0),
+      dominant_frequency_(0.0),
+      shifter_(window_size, hop_size, max_voices) {
+  assert(sample_rate_ > 0);
+  assert(max_voices <= kMaxActiveNotes);
+  shifter_.set_frame_analyzer(this);
+  Reset();
+}
+
+template <typename Real>
+void PitchModulator<Real>::set_sample_rate(int sample_rate) {
+  assert(sample_rate > 0);
+  sample_rate_ = sample_rate;
+  tracker_.set_sample_rate(sample_rate);
+}
+
+template <typename Real>
+void PitchModulator<Real>::HandleEvent(const MIDI::Event& event) {
+  double* end = active_notes_ + active_note_count_;
+  double* note = find(active_notes_, end, event.real_value);
+  if (event.type == MIDI::Event::RESET) {
+    active_note_count_ = 0;
+  } else if (event.type == MIDI::Event::NOTE_ON) {
+    if (note == end && active_note_count_ < kMaxActiveNotes) {
+      active_notes_[active_note_count_++] = event.real_value;
+    }
+  } else if (event.type == MIDI::Event::NOTE_OFF) {
+    if (note != end) {
+      copy(note + 1, end, note);
+      --active_note_count_;
+    }
+  }
+}
+
+template <typename Real>
+size_t PitchModulator<Real>::Process(const Real* input,
+                                     size_t sample_count,
+                                     Real* output) {
+  assert(input != NULL || sample_count == 0);
+  assert(output != NULL || sample_count == 0);
+
+  // Each frame is analyzed by AnalyzeFrame() as the shifter processes it.
+  frame_count_ = 0;
+  shifter_.Process(input, sample_count, output);
+  return frame_count_;
+}
+
+template <typename Real>
+void PitchModulator<Real>::Reset() {
+  active_note_count_ = 0;
+  tracker_.Reset();
+  dominant_frequency_ = 0.0;
+  fill(target_frequencies_, target_frequencies_ + kMaxActiveNotes, 0.0);
+  shifter_.Reset();
+}
+
+template <typename Real>
+void PitchModulator<Real>::AnalyzeFrame(
+    const typename FFT<Real>::Complex* spectrum) {
+  ++frame_count_;
+
+  // The lowest held notes are the targets, one per voice.
+  size_t voice_count = 1;
+  target_frequencies_[0] = kDefaultTargetFrequency;
+  if (active_note_count_ > 0) {
+    voice_count = min(active_note_count_, shifter_.max_voices());
+    copy(active_notes_, active_notes_ + active_note_count_,
+         target_frequencies_);
+    partial_sort(target_frequencies_, target_frequencies_ + voice_count,
+                 target_frequencies_ + active_note_count_);
+  }
+  // Tracked pitches which were not heard in this frame are fading out. Without
+  // any heard, the ratios of the previous frame are kept.
+  dominant_frequency_ = 0.0;
+  size_t pitch_count = tracker_.Track(spectrum);
+  for (size_t pitch = 0; pitch < pitch_count; ++pitch) {
+    if (tracker_.pitches()[pitch].missed_frames == 0) {
+      dominant_frequency_ = tracker_.pitches()[pitch].frequency;
+      break;
+    }
+  }
+  if (dominant_frequency_ > 0.0) {
+    shifter_.set_voice_count(voice_count);
+    for (size_t voice = 0; voice < voice_count; ++voice) {
+      shifter_.set_pitch_ratio(
+          voice, target_frequencies_[voice] / dominant_frequency_);
+    }
+  }
+}
+
+// Explicit template instantiations of supported types.
+template class PitchModulator<float>;
+template class PitchModulator<double>;
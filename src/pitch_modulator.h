@@ -0,0 +1,100 @@
+#ifndef PITCH_MODULATOR_H_
+#define PITCH_MODULATOR_H_
+
+#include <stddef.h>
+
+#include "callback_profiler.h"
+#include "fft.h"
+#include "midi.h"
+#include "pitch_shifter.h"
+#include "pitch_tracker.h"
+
+// PitchModulator tunes a signal, block by block, to the lowest note held on a
+// MIDI input, or to 440 Hz while no note is held. The signal is analyzed in the
+// Hann windowed frames of a PitchShifter, independently of the block size, and
+// each frame is shifted by the ratio of the target frequency to its dominant
+// frequency: the strongest pitch heard in the frame by a PitchTracker, whose
+// harmonics are grouped with it. The tracker reads the spectrum of the forward
+// FFT of the shifter, as its FrameAnalyzer, so each frame is transformed once.
+//
+// As a harmonizer, with up to 'max_voices' voices, the signal is tuned to each
+// of the lowest notes held instead, and the voices are mixed. The analysis of a
+// frame, and its dominant frequency, are shared by its voices, see
+// PitchShifter.
+//
+// This is the processing chain of jack_pitch_modulator, shared with its offline
+// driver. All buffers and FFT plans are created by the constructor, so that
+// neither HandleEvent() nor Process() allocate, lock or plan. The
+// PitchModulator interface is not thread-safe.
+template <typename Real>
+class PitchModulator : private PitchShifter<Real>::FrameAnalyzer {
+ public:
+  // Default frames, in samples, and how many times they overlap. Longer windows
+  // resolve pitches more accurately, at the cost of latency.
+  static const size_t kDefaultWindowSize = 2048;
+  static const size_t kDefaultOverlap = 4;
+
+  // Notes held at once, beyond which further notes are ignored.
+  static const size_t kMaxActiveNotes = 128;
+
+  // 'hop_size' must divide 'window_size' at least 4 times.
+  PitchModulator(size_t window_size,
+                 size_t hop_size,
+                 int sample_rate,
+                 size_t max_voices = 1);
+
+  size_t window_size() const { return shifter_.window_size(); }
+  size_t hop_size() const { return shifter_.hop_size(); }
+  size_t latency() const { return shifter_.latency(); }  // Samples.
+  size_t max_voices() const { return shifter_.max_voices(); }
+
+  int sample_rate() const { return sample_rate_; }
+  void set_sample_rate(int sample_rate);
+
+  // Hold or release notes on NOTE_ON, NOTE_OFF and RESET events. Other events
+  // are ignored.
+  void HandleEvent(const MIDI::Event& event);
+
+  // Tune the next 'sample_count' samples of the signal from 'input' into
+  // 'output', which may be the same array. Returns the number of frames
+  // analyzed.
+  size_t Process(const Real* input, size_t sample_count, Real* output);
+
+  // The frequencies of the last frame analyzed, 0 before the first frame or if
+  // no pitch was heard in it, and its targets, lowest first.
+  double dominant_frequency() const { return dominant_frequency_; }
+  size_t voice_count() const { return shifter_.voice_count(); }
+  double target_frequency(size_t voice = 0) const {
+    return target_frequencies_[voice];
+  }
+
+  // Forget the signal and the held notes.
+  void Reset();
+
+  // Time the analysis and shifting of frames into 'profiler', or nothing if
+  // NULL. The caller times the callback as a whole.
+  void set_profiler(CallbackProfiler* profiler) {
+    shifter_.set_profiler(profiler);
+  }
+
+ private:
+  // Retune the pitch shifter from the dominant frequency of the spectrum of
+  // its frame.
+  virtual void AnalyzeFrame(const typename FFT<Real>::Complex* spectrum);
+
+  int sample_rate_;
+
+  // Frequencies of the held notes, in the order they were played.
+  double active_notes_[kMaxActiveNotes];
+  size_t active_note_count_;
+
+  PitchTracker<Real> tracker_;
+  size_t frame_count_;  // Analyzed by the current Process().
+
+  double dominant_frequency_;
+  double target_frequencies_[kMaxActiveNotes];
+
+  PitchShifter<Real> shifter_;
+};
+
+#endif  // PITCH_MODULATOR_H_
@@ -0,0 +1,196 @@
+#include "pitch_shifter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Wrap a phase to [-pi, pi).
+double WrapPhase(double phase) {
+  return phase - 2.0 * M_PI * floor(phase / (2.0 * M_PI) + 0.5);
+}
+
+template <typename Real>
+PitchShifter<Real>::PitchShifter(size_t window_size,
+                                 size_t hop_size,
+                                 size_t max_voices)
+    : window_size_(window_size), hop_size_(hop_size),
+      bin_count_(window_size / 2 + 1), max_voices_(max_voices),
+      voice_count_(1), pitch_ratios_(max_voices, 1.0), window_(window_size),
+      output_scale_(0.0), input_frame_(window_size), frame_fill_(0),
+      output_sum_(window_size), analysis_phases_(bin_count_),
+      input_magnitudes_(bin_count_), input_frequencies_(bin_count_),
+      shifted_magnitudes_(bin_count_), shifted_frequencies_(bin_count_),
+      synthesis_phases_(bin_count_ * max_voices), analyzer_(NULL),
+      profiler_(NULL) {
+  assert(hop_size_ > 0);
+  assert(max_voices_ > 0);
+  assert(window_size_ % hop_size_ == 0);
+  assert(window_size_ / hop_size_ >= 4);
+
+  for (size_t sample = 0; sample < window_size_; ++sample) {
+    window_[sample] = 0.5 - 0.5 * cos(2.0 * M_PI * sample / window_size_);
+  }
+  // Frames are windowed twice. The squared windows of overlapping frames add
+  // up to the same gain at every sample.
+  double gain = 0.0;
+  for (size_t sample = 0; sample < window_size_; sample += hop_size_) {
+    gain += window_[sample] * window_[sample];
+  }
+  output_scale_ = 1.0 / gain;
+
+  FFT<Real>::PreparePlans(window_size_, &fft_decomposition_);
+  Reset();
+}
+
+template <typename Real>
+void PitchShifter<Real>::set_voice_count(size_t voice_count) {
+  assert(voice_count > 0 && voice_count <= max_voices_);
+  voice_count_ = voice_count;
+}
+
+template <typename Real>
+void PitchShifter<Real>::set_pitch_ratio(size_t voice, double pitch_ratio) {
+  assert(voice < max_voices_);
+  assert(pitch_ratio > 0.0);
+  pitch_ratios_[voice] = pitch_ratio;
+}
+
+template <typename Real>
+void PitchShifter<Real>::Process(const Real* input,
+                                 size_t sample_count,
+                                 Real* output) {
+  assert(input != NULL || sample_count == 0);
+  assert(output != NULL || sample_count == 0);
+
+  // Samples are taken in runs up to the end of the current frame. Each run is
+  // read before its output is written, so 'input' and 'output' may overlap.
+  // Frames overlap by 'overlap_size' samples, after which a hop of input fills
+  // the frame while the complete hop of output is taken.
+  size_t overlap_size = window_size_ - hop_size_;
+  size_t done = 0;
+  while (done < sample_count) {
+    size_t run = min(sample_count - done, window_size_ - frame_fill_);
+    memcpy(&input_frame_[frame_fill_], input + done, run * sizeof(Real));
+    memcpy(output + done, &output_sum_[frame_fill_ - overlap_size],
+           run * sizeof(Real));
+    frame_fill_ += run;
+    done += run;
+    if (frame_fill_ == window_size_) {
+      ProcessFrame();
+      copy(input_frame_.begin() + hop_size_, input_frame_.end(),
+           input_frame_.begin());
+      frame_fill_ = overlap_size;
+    }
+  }
+}
+
+template <typename Real>
+void PitchShifter<Real>::Reset() {
+  fill(input_frame_.begin(), input_frame_.end(), 0);
+  fill(output_sum_.begin(), output_sum_.end(), 0);
+  fill(analysis_phases_.begin(), analysis_phases_.end(), 0.0);
+  fill(synthesis_phases_.begin(), synthesis_phases_.end(), 0.0);
+  // The signal is preceded by silence, so that the first frame completes after
+  // a hop.
+  frame_fill_ = window_size_ - hop_size_;
+}
+
+template <typename Real>
+void PitchShifter<Real>::ProcessFrame() {
+  typedef typename FFT<Real>::Complex Complex;
+  int64_t time = profiler_ != NULL ? profiler_->Mark() : 0;
+
+  // The work buffer of the decomposition is aligned for FFTW, and transformed
+  // in place.
+  Real* frame = fft_decomposition_.samples;
+  for (size_t sample = 0; sample < window_size_; ++sample) {
+    frame[sample] = input_frame_[sample] * window_[sample];
+  }
+  FFT<Real>::FFTDecompose(window_size_, frame, &fft_decomposition_);
+  if (profiler_ != NULL) {
+    time = profiler_->AddStage(CallbackProfiler::FFT, time);
+  }
+  if (analyzer_ != NULL) {
+    analyzer_->AnalyzeFrame(fft_decomposition_.fft_decomposition);
+    if (profiler_ != NULL) {
+      time = profiler_->AddStage(CallbackProfiler::PITCH_DETECTION, time);
+    }
+  }
+
+  // Analysis. The phase advance of a bin over a hop, beyond that of its center
+  // frequency, gives its true frequency.
+  Complex* bins = fft_decomposition_.fft_decomposition;
+  double bin_advance = 2.0 * M_PI * hop_size_ / window_size_;  // Of a center.
+  for (size_t bin = 0; bin < bin_count_; ++bin) {
+    double phase = atan2(bins[bin][1], bins[bin][0]);
+    double deviation =
+        WrapPhase(phase - analysis_phases_[bin] - bin * bin_advance);
+    analysis_phases_[bin] = phase;
+    input_magnitudes_[bin] = sqrt(bins[bin][0] * bins[bin][0] +
+                                  bins[bin][1] * bins[bin][1]);
+    input_frequencies_[bin] = bin + deviation / bin_advance;
+  }
+
+  // Synthesis. The voices are mixed into the output bins.
+  for (size_t bin = 0; bin < bin_count_; ++bin) {
+    bins[bin][0] = 0;
+    bins[bin][1] = 0;
+  }
+  for (size_t voice = 0; voice < voice_count_; ++voice) {
+    ShiftVoice(voice, 1.0 / voice_count_);
+  }
+  if (profiler_ != NULL) {
+    time = profiler_->AddStage(CallbackProfiler::SHIFT, time);
+  }
+  FFT<Real>::FFTRecompose(fft_decomposition_, frame);
+
+  // Overlap-add, after moving the hop already output out of the sum.
+  copy(output_sum_.begin() + hop_size_, output_sum_.end(),
+       output_sum_.begin());
+  fill(output_sum_.end() - hop_size_, output_sum_.end(), 0);
+  for (size_t sample = 0; sample < window_size_; ++sample) {
+    output_sum_[sample] += frame[sample] * window_[sample] * output_scale_;
+  }
+  if (profiler_ != NULL) {
+    profiler_->AddStage(CallbackProfiler::INVERSE_FFT, time);
+  }
+}
+
+template <typename Real>
+void PitchShifter<Real>::ShiftVoice(size_t voice, double gain) {
+  typedef typename FFT<Real>::Complex Complex;
+
+  // Move the bins by the pitch ratio. Bins landing together add up.
+  double pitch_ratio = pitch_ratios_[voice];
+  fill(shifted_magnitudes_.begin(), shifted_magnitudes_.end(), 0.0);
+  fill(shifted_frequencies_.begin(), shifted_frequencies_.end(), 0.0);
+  for (size_t bin = 0; bin < bin_count_; ++bin) {
+    size_t shifted_bin = static_cast<size_t>(bin * pitch_ratio + 0.5);
+    if (shifted_bin >= bin_count_) {
+      break;
+    }
+    shifted_magnitudes_[shifted_bin] += input_magnitudes_[bin];
+    shifted_frequencies_[shifted_bin] = input_frequencies_[bin] * pitch_ratio;
+  }
+
+  // Output phases advance by the new frequencies. Empty bins add nothing.
+  Complex* bins = fft_decomposition_.fft_decomposition;
+  double* phases = &synthesis_phases_[voice * bin_count_];
+  double bin_advance = 2.0 * M_PI * hop_size_ / window_size_;
+  for (size_t bin = 0; bin < bin_count_; ++bin) {
+    phases[bin] =
+        WrapPhase(phases[bin] + shifted_frequencies_[bin] * bin_advance);
+    if (shifted_magnitudes_[bin] > 0.0) {
+      double magnitude = gain * shifted_magnitudes_[bin];
+      bins[bin][0] += magnitude * cos(phases[bin]);
+      bins[bin][1] += magnitude * sin(phases[bin]);
+    }
+  }
+}
+
+// Explicit template instantiations of supported types.
+template class PitchShifter<float>;
+template class PitchShifter<double>;
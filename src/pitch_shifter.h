@@ -0,0 +1,124 @@
+#ifndef PITCH_SHIFTER_H_
+#define PITCH_SHIFTER_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "callback_profiler.h"
+#include "fft.h"
+
+// PitchShifter shifts the pitch of a continuous signal, block by block, with a
+// phase vocoder. The signal is cut into Hann windowed frames of 'window_size'
+// samples, 'hop_size' samples apart. The true frequency of each bin of a frame
+// is estimated from its phase advance since the previous frame, bins are moved
+// and their frequencies scaled by the pitch ratio, and the phases of the output
+// bins are accumulated from their new frequencies, so that they stay coherent
+// across frames. The output frames are windowed again and overlap-added.
+//
+// Several voices, each with its own pitch ratio, may be shifted from the same
+// input and mixed, as for harmonies. They share the analysis of each frame, and
+// are mixed in the frequency domain, so that each voice only adds the moving
+// of the bins and the accumulation of their phases to a frame, without any
+// further FFT.
+//
+// The spectrum of each frame may also be handed to a FrameAnalyzer, between
+// the forward FFT and the shifting, such as to detect its pitch and set the
+// pitch ratios which shift it, without transforming the frame again.
+//
+// Blocks may be of any size, and the output lags the input by latency()
+// samples. All buffers and FFT plans are created by the constructor, so that
+// Process() neither allocates nor plans. The PitchShifter interface is not
+// thread-safe.
+//
+// The stages of each frame are timed into a CallbackProfiler, if one is set.
+template <typename Real>
+class PitchShifter {
+ public:
+  // Analyzes each frame before it is shifted. See set_frame_analyzer().
+  class FrameAnalyzer {
+   public:
+    virtual ~FrameAnalyzer() {}
+
+    // Called with the window_size / 2 + 1 bins of the Hann windowed frame.
+    // Voice counts and pitch ratios set by the call apply to the frame.
+    virtual void AnalyzeFrame(const typename FFT<Real>::Complex* spectrum) = 0;
+  };
+
+  // 'hop_size' must divide 'window_size' at least 4 times. There is a single
+  // voice until set_voice_count() is called.
+  PitchShifter(size_t window_size, size_t hop_size, size_t max_voices = 1);
+
+  size_t window_size() const { return window_size_; }
+  size_t hop_size() const { return hop_size_; }
+  size_t latency() const { return window_size_; }  // Samples.
+
+  // Voices mixed into the output, at equal gains adding up to 1, from 1 to
+  // max_voices(). Takes effect from the next frame.
+  size_t max_voices() const { return max_voices_; }
+  size_t voice_count() const { return voice_count_; }
+  void set_voice_count(size_t voice_count);
+
+  // Ratio of output to input frequencies of a voice, 1 leaving the pitch
+  // unchanged, of the first voice if none is given. Takes effect from the next
+  // frame.
+  double pitch_ratio(size_t voice = 0) const { return pitch_ratios_[voice]; }
+  void set_pitch_ratio(double pitch_ratio) { set_pitch_ratio(0, pitch_ratio); }
+  void set_pitch_ratio(size_t voice, double pitch_ratio);
+
+  // Shift the next 'sample_count' samples of the signal from 'input' into
+  // 'output', which may be the same array.
+  void Process(const Real* input, size_t sample_count, Real* output);
+
+  // Forget the signal, as if nothing had been processed.
+  void Reset();
+
+  // Time the stages of frames into 'profiler', or nothing if NULL.
+  void set_profiler(CallbackProfiler* profiler) { profiler_ = profiler; }
+
+  // Analyze the spectrum of each frame with 'analyzer', timed as the
+  // PITCH_DETECTION stage, or nothing if NULL. The analyzer must outlive its
+  // use by the shifter.
+  void set_frame_analyzer(FrameAnalyzer* analyzer) { analyzer_ = analyzer; }
+
+ private:
+  // Shift the frame in 'input_frame_' and overlap-add it to 'output_sum_'.
+  void ProcessFrame();
+
+  // Add a voice, shifted from the analysis of the frame, to its output bins
+  // scaled by 'gain'.
+  void ShiftVoice(size_t voice, double gain);
+
+  const size_t window_size_;
+  const size_t hop_size_;
+  const size_t bin_count_;
+  const size_t max_voices_;
+  size_t voice_count_;
+  std::vector<double> pitch_ratios_;  // Per voice.
+
+  std::vector<Real> window_;  // Hann window.
+  double output_scale_;       // Undoes the gain of overlapping windows.
+
+  // The last window of input, filled up to 'frame_fill_' samples. Each frame
+  // is processed once filled, and then moved back by a hop.
+  std::vector<Real> input_frame_;
+  size_t frame_fill_;
+
+  // Overlap-added output frames. The first hop, covered by all overlapping
+  // frames, is complete and is output while the next frame fills.
+  std::vector<Real> output_sum_;
+
+  typename FFT<Real>::FFTDecomposition fft_decomposition_;
+
+  // Per bin state, with window_size / 2 + 1 bins.
+  std::vector<double> analysis_phases_;       // Input phases of the last frame.
+  std::vector<double> input_magnitudes_;      // Of the input bins.
+  std::vector<double> input_frequencies_;     // Of the input bins, in bins.
+  std::vector<double> shifted_magnitudes_;    // Of the bins of a voice.
+  std::vector<double> shifted_frequencies_;   // Of the bins of a voice.
+  std::vector<double> synthesis_phases_;  // Accumulated, voice after voice.
+
+  FrameAnalyzer* analyzer_;
+  CallbackProfiler* profiler_;
+};
+
+#endif  // PITCH_SHIFTER_H_
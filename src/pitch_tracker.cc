@@ -0,0 +1,259 @@
+#include "pitch_tracker.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+// Candidate peaks considered per tracked pitch, leaving room for harmonics.
+const size_t kPeaksPerPitch = 4;
+
+// Peaks weaker than this fraction of the strongest squared magnitude (-40 dB)
+// are ignored.
+const double kPeakFloor = 1e-4;
+
+// Highest harmonic grouped with its fundamental, and how far from an exact
+// multiple of the fundamental it may lie, relative to its frequency.
+const int kMaxHarmonic = 8;
+const double kHarmonicTolerance = 0.03;
+
+// Frames of one pitch are matched within a semitone.
+const double kMatchDistance = log(2.0) / 12.0;  // Log frequency.
+
+// Frames a pitch is kept for after it was last heard.
+const int kMaxMissedFrames = 3;
+
+// Compute the squared magnitudes of 'count' complex values.
+template <typename Complex, typename Real>
+void SquaredMagnitudes(const Complex* values, size_t count, Real* magnitudes) {
+  for (size_t value = 0; value < count; ++value) {
+    magnitudes[value] = values[value][0] * values[value][0] +
+                        values[value][1] * values[value][1];
+  }
+}
+
+#ifdef __SSE__
+// Single precision values are done four at a time: the real and imaginary parts
+// of two loads are separated by shuffles, squared and added.
+void SquaredMagnitudes(const fftwf_complex* values, size_t count,
+                       float* magnitudes) {
+  const float* parts = values[0];
+  size_t value = 0;
+  for (; value + 4 <= count; value += 4) {
+    __m128 low = _mm_loadu_ps(parts + 2 * value);       // r0 i0 r1 i1
+    __m128 high = _mm_loadu_ps(parts + 2 * value + 4);  // r2 i2 r3 i3
+    __m128 real = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 imaginary = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(magnitudes + value,
+                  _mm_add_ps(_mm_mul_ps(real, real),
+                             _mm_mul_ps(imaginary, imaginary)));
+  }
+  SquaredMagnitudes<fftwf_complex, float>(values + value, count - value,
+                                          magnitudes + value);
+}
+#endif
+
+template <typename Real>
+PitchTracker<Real>::PitchTracker(size_t frame_size,
+                                 int sample_rate,
+                                 size_t max_pitches)
+    : frame_size_(frame_size), sample_rate_(sample_rate),
+      max_pitches_(max_pitches), max_peaks_(max_pitches * kPeaksPerPitch),
+      smoothing_(0.5), magnitudes_(frame_size / 2 + 1) {
+  assert(frame_size_ >= 4);
+  assert(sample_rate_ > 0);
+  assert(max_pitches_ > 0);
+  peaks_.reserve(max_peaks_);
+  frame_pitches_.reserve(max_peaks_);
+  pitches_.reserve(max_pitches_);
+  matched_.reserve(max_pitches_);
+}
+
+template <typename Real>
+void PitchTracker<Real>::set_sample_rate(int sample_rate) {
+  assert(sample_rate > 0);
+  sample_rate_ = sample_rate;
+}
+
+template <typename Real>
+void PitchTracker<Real>::set_smoothing(double smoothing) {
+  assert(smoothing >= 0.0 && smoothing < 1.0);
+  smoothing_ = smoothing;
+}
+
+template <typename Real>
+size_t PitchTracker<Real>::Track(
+    const typename FFT<Real>::Complex* spectrum) {
+  assert(spectrum != NULL);
+  SquaredMagnitudes(spectrum, magnitudes_.size(), &magnitudes_[0]);
+  FindPeaks();
+  GroupHarmonics();
+  UpdatePitches();
+  return pitches_.size();
+}
+
+template <typename Real>
+bool PitchTracker<Real>::MagnitudeGreater(const Peak& peak_a,
+                                          const Peak& peak_b) {
+  return peak_a.magnitude > peak_b.magnitude;
+}
+
+template <typename Real>
+bool PitchTracker<Real>::FrequencyLess(const Peak& peak_a,
+                                       const Peak& peak_b) {
+  return peak_a.frequency < peak_b.frequency;
+}
+
+template <typename Real>
+bool PitchTracker<Real>::SalienceGreater(const Pitch& pitch_a,
+                                         const Pitch& pitch_b) {
+  return pitch_a.salience > pitch_b.salience;
+}
+
+template <typename Real>
+void PitchTracker<Real>::FindPeaks() {
+  // DC and the Nyquist frequency are not peaks.
+  const Real* magnitudes = &magnitudes_[0];
+  size_t last_bin = magnitudes_.size() - 1;
+  Real max_magnitude = *max_element(magnitudes + 1, magnitudes + last_bin);
+  Real floor_magnitude = max_magnitude * kPeakFloor;
+
+  // The strongest local maxima are kept in a heap, weakest on top.
+  peaks_.clear();
+  for (size_t bin = 1; bin < last_bin; ++bin) {
+    Real magnitude = magnitudes[bin];
+    if (magnitude <= floor_magnitude || magnitude <= magnitudes[bin - 1] ||
+        magnitude < magnitudes[bin + 1]) {
+      continue;
+    }
+    if (peaks_.size() == max_peaks_) {
+      if (magnitude <= peaks_.front().magnitude) {
+        continue;
+      }
+      pop_heap(peaks_.begin(), peaks_.end(), MagnitudeGreater);
+      peaks_.pop_back();
+    }
+    // Refined by the parabola through the log magnitudes of the peak and its
+    // neighbors, which are all positive here. A peak which does not fit a
+    // parabola is taken at its bin.
+    double before = log(max<double>(magnitudes[bin - 1], floor_magnitude));
+    double at = log(static_cast<double>(magnitude));
+    double after = log(max<double>(magnitudes[bin + 1], floor_magnitude));
+    double offset = 0.5 * (before - after) / (before - 2.0 * at + after);
+    if (!(offset >= -0.5 && offset <= 0.5)) {
+      offset = 0.0;
+    }
+    Peak peak;
+    peak.frequency = (bin + offset) * sample_rate_ / frame_size_;
+    peak.magnitude = sqrt(static_cast<double>(magnitude));
+    peaks_.push_back(peak);
+    push_heap(peaks_.begin(), peaks_.end(), MagnitudeGreater);
+  }
+}
+
+template <typename Real>
+void PitchTracker<Real>::GroupHarmonics() {
+  // Lower peaks become fundamentals first, so each higher peak is grouped with
+  // the lowest pitch it is a harmonic of.
+  sort(peaks_.begin(), peaks_.end(), FrequencyLess);
+  frame_pitches_.clear();
+  for (size_t peak = 0; peak < peaks_.size(); ++peak) {
+    bool grouped = false;
+    for (size_t pitch = 0; pitch < frame_pitches_.size() && !grouped;
+         ++pitch) {
+      double ratio = peaks_[peak].frequency / frame_pitches_[pitch].frequency;
+      double harmonic = floor(ratio + 0.5);
+      if (harmonic >= 2 && harmonic <= kMaxHarmonic &&
+          fabs(ratio - harmonic) <= harmonic * kHarmonicTolerance) {
+        frame_pitches_[pitch].salience += peaks_[peak].magnitude;
+        ++frame_pitches_[pitch].harmonic_count;
+        grouped = true;
+      }
+    }
+    if (!grouped) {
+      Pitch pitch;
+      pitch.frequency = peaks_[peak].frequency;
+      pitch.salience = peaks_[peak].magnitude;
+      pitch.harmonic_count = 1;
+      pitch.missed_frames = 0;
+      frame_pitches_.push_back(pitch);
+    }
+  }
+  sort(frame_pitches_.begin(), frame_pitches_.end(), SalienceGreater);
+  if (frame_pitches_.size() > max_pitches_) {
+    frame_pitches_.resize(max_pitches_);
+  }
+}
+
+template <typename Real>
+void PitchTracker<Real>::UpdatePitches() {
+  // Frame pitches, strongest first, continue the nearest unmatched pitch.
+  // Matched frame pitches are marked by a zero salience.
+  matched_.assign(pitches_.size(), false);
+  for (size_t frame_pitch = 0; frame_pitch < frame_pitches_.size();
+       ++frame_pitch) {
+    Pitch& heard = frame_pitches_[frame_pitch];
+    size_t nearest = pitches_.size();
+    double nearest_distance = kMatchDistance;
+    for (size_t pitch = 0; pitch < pitches_.size(); ++pitch) {
+      double distance = fabs(log(heard.frequency / pitches_[pitch].frequency));
+      if (!matched_[pitch] && distance <= nearest_distance) {
+        nearest = pitch;
+        nearest_distance = distance;
+      }
+    }
+    if (nearest == pitches_.size()) {
+      continue;
+    }
+    Pitch& tracked = pitches_[nearest];
+    tracked.frequency = exp(smoothing_ * log(tracked.frequency) +
+                            (1.0 - smoothing_) * log(heard.frequency));
+    tracked.salience = smoothing_ * tracked.salience +
+        (1.0 - smoothing_) * heard.salience;
+    tracked.harmonic_count = heard.harmonic_count;
+    tracked.missed_frames = 0;
+    matched_[nearest] = true;
+    heard.salience = 0.0;
+  }
+
+  // Pitches not heard fade, and are dropped after a while.
+  size_t kept = 0;
+  for (size_t pitch = 0; pitch < pitches_.size(); ++pitch) {
+    if (!matched_[pitch]) {
+      pitches_[pitch].salience *= smoothing_;
+      if (++pitches_[pitch].missed_frames > kMaxMissedFrames) {
+        continue;
+      }
+    }
+    pitches_[kept++] = pitches_[pitch];
+  }
+  pitches_.resize(kept);
+
+  // New pitches take free places, or those of weaker pitches.
+  for (size_t frame_pitch = 0; frame_pitch < frame_pitches_.size();
+       ++frame_pitch) {
+    const Pitch& heard = frame_pitches_[frame_pitch];
+    if (heard.salience == 0.0) {
+      continue;
+    }
+    if (pitches_.size() < max_pitches_) {
+      pitches_.push_back(heard);
+      continue;
+    }
+    // Last in order of decreasing salience.
+    typename vector<Pitch>::iterator weakest =
+        max_element(pitches_.begin(), pitches_.end(), SalienceGreater);
+    if (weakest->salience < heard.salience) {
+      *weakest = heard;
+    }
+  }
+  sort(pitches_.begin(), pitches_.end(), SalienceGreater);
+}
+
+// Explicit template instantiations of supported types.
+template class PitchTracker<float>;
+template class PitchTracker<double>;
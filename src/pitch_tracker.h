@@ -0,0 +1,86 @@
+#ifndef PITCH_TRACKER_H_
+#define PITCH_TRACKER_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "fft.h"
+
+// PitchTracker follows up to 'max_pitches' simultaneous pitches through the
+// spectra of consecutive frames of a signal, such as those of a Spectrogram or
+// of successive FFTDecompositions.
+//
+// For each frame, the squared magnitudes of the bins are computed (with SSE for
+// float spectra) and the strongest local maxima are refined to fractional bins
+// by fitting a parabola to their log magnitudes. Peaks lying at a harmonic of a
+// lower peak are grouped into its pitch, whose salience sums the magnitudes of
+// its harmonics. The pitches of the frame are then matched to those tracked so
+// far, within a semitone, and smoothed exponentially; pitches no longer heard
+// fade out for a few frames before being dropped.
+//
+// All buffers are allocated by the constructor, so tracking a frame takes time
+// linear in the number of bins, and never allocates. The PitchTracker interface
+// is not thread-safe; use one tracker per stream.
+template <typename Real>
+class PitchTracker {
+ public:
+  struct Pitch {
+    double frequency;    // Hz.
+    double salience;     // Summed magnitude of the harmonics heard.
+    int harmonic_count;  // Harmonics heard, including the fundamental.
+    int missed_frames;   // Consecutive frames without the pitch.
+  };
+
+  PitchTracker(size_t frame_size, int sample_rate, size_t max_pitches);
+
+  int sample_rate() const { return sample_rate_; }
+  void set_sample_rate(int sample_rate);
+
+  // Weight of the previous estimate when smoothing, in [0, 1). 0 reports each
+  // frame as it is.
+  double smoothing() const { return smoothing_; }
+  void set_smoothing(double smoothing);
+
+  // Track the pitches of the next frame, given its spectrum of
+  // frame_size / 2 + 1 bins. Returns the number of pitches tracked.
+  size_t Track(const typename FFT<Real>::Complex* spectrum);
+
+  // The tracked pitches, strongest first.
+  const std::vector<Pitch>& pitches() const { return pitches_; }
+
+  // Forget all tracked pitches.
+  void Reset() { pitches_.clear(); }
+
+ private:
+  struct Peak {
+    double frequency;  // Hz.
+    double magnitude;
+  };
+
+  static bool MagnitudeGreater(const Peak& peak_a, const Peak& peak_b);
+  static bool FrequencyLess(const Peak& peak_a, const Peak& peak_b);
+  static bool SalienceGreater(const Pitch& pitch_a, const Pitch& pitch_b);
+
+  // Find the strongest peaks of the frame in 'magnitudes_' into 'peaks_'.
+  void FindPeaks();
+
+  // Group 'peaks_' into the pitches of the frame, in 'frame_pitches_'.
+  void GroupHarmonics();
+
+  // Match and smooth the pitches of the frame into 'pitches_'.
+  void UpdatePitches();
+
+  const size_t frame_size_;
+  int sample_rate_;
+  const size_t max_pitches_;
+  const size_t max_peaks_;
+  double smoothing_;
+
+  std::vector<Real> magnitudes_;  // Squared, per bin.
+  std::vector<Peak> peaks_;
+  std::vector<Pitch> frame_pitches_;
+  std::vector<Pitch> pitches_;
+  std::vector<bool> matched_;  // Per entry of 'pitches_'.
+};
+
+#endif  // PITCH_TRACKER_H_
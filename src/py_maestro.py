@@ -4,9 +4,17 @@
 # musical composition language. The purpose of this interface is to make musical
 # composition as easy and as painless as possible.
 
+import math
+import struct
 from copy import deepcopy
 
 
+# Compiled score (.maec) format version, and the sample rate maestro renders at.
+# See compiled_score.h.
+COMPILED_SCORE_VERSION = 1
+SAMPLE_RATE = 22000
+
+
 # Note defines a sound of constant length.
 class Note:
     def __init__(self, frequency = 0, volume = 1, length = 1):
@@ -91,6 +99,37 @@ class Segment:
         segment_string = segment_string[0:-3]
         return segment_string
 
+    # Write the segment as a compiled (.maec) score, which maestro renders
+    # directly, without the .mae text round trip. Rests are silent, so they are
+    # left out. The file is little endian, like the machines maestro runs on.
+    def WriteCompiled(self, path, sample_rate = SAMPLE_RATE):
+        def ToSamples(seconds):
+            return int(math.floor(seconds * sample_rate + 0.5))
+        notes = []
+        for rift in self.rifts:
+            time = 0.0
+            for note in rift:
+                if note.volume != 0:
+                    notes.append((ToSamples(time), ToSamples(note.length),
+                                  note.frequency, note.volume))
+                time += note.length
+        notes.sort(key = lambda note: note[0])
+        count = len(notes)
+        # Rounding may end notes just past the score, which then covers them.
+        length = max([ToSamples(self.Length())] +
+                     [start + note_length
+                      for start, note_length, _, _ in notes])
+        columns = list(zip(*notes)) if count else [(), (), (), ()]
+        output = open(path, 'wb')
+        output.write(struct.pack('<4sIIIqq', b'MAEC', COMPILED_SCORE_VERSION,
+                                 0x01020304, sample_rate, count,
+                                 length))
+        output.write(struct.pack('<%dq' % count, *columns[0]))
+        output.write(struct.pack('<%dq' % count, *columns[1]))
+        output.write(struct.pack('<%df' % count, *columns[2]))
+        output.write(struct.pack('<%df' % count, *columns[3]))
+        output.close()
+
 
 # Helper methods for bundling redundant code. This fundamentally adds no new
 # functionality.
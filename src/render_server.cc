@@ -0,0 +1,510 @@
+#include "render_server.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sndfile.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "parser.h"
+#include "render_sink.h"
+
+using namespace std;
+
+// Longest accepted request line, in bytes.
+const size_t kMaxRequestLineLength = 4096;
+
+struct RenderServer::CacheEntry {
+  string key;
+  PreparedSegment prepared;
+  size_t size;  // Bytes.
+  int users;    // Jobs currently rendering the score.
+  list<CacheEntry*>::iterator order;  // Position in 'cache_order_'.
+};
+
+struct RenderServer::Job {
+  Job()
+      : done(false), succeeded(false), cached(false), queue_depth(0),
+        submit_time(0.0), start_time(0.0), prepared_time(0.0),
+        finish_time(0.0) {}
+
+  // The request. Inline jobs have an empty 'input_path'.
+  string format;
+  string output_path;
+  string input_path;
+  string text;
+
+  // The outcome, guarded by the server mutex.
+  bool done;
+  bool succeeded;
+  bool cached;  // Whether the prepared score was taken from the cache.
+  string error;
+  size_t queue_depth;
+  double submit_time;  // Seconds.
+  double start_time;
+  double prepared_time;
+  double finish_time;
+};
+
+// A connection handed to a connection thread.
+struct ServerConnection {
+  RenderServer* server;
+  int socket;
+};
+
+double MonotonicSeconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+bool SendAll(int socket, const string& data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t result = send(socket, data.data() + sent, data.size() - sent,
+                          MSG_NOSIGNAL);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+// Receive from 'socket' until 'buffer' holds at least 'size' bytes, or a new
+// line if 'size' is zero. Returns false if the peer stops sending first.
+bool ReceiveUntil(int socket, size_t size, string* buffer) {
+  char data[4096];
+  while (size > 0 ? buffer->size() < size
+                  : buffer->find('\n') == string::npos) {
+    if (size == 0 && buffer->size() > kMaxRequestLineLength) {
+      return false;
+    }
+    ssize_t result = recv(socket, data, sizeof(data), 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    buffer->append(data, result);
+  }
+  return true;
+}
+
+// Render a prepared score to a file of the given maestro output format.
+bool RenderToFile(const Renderer<SampleType, AccumulatorType>& renderer,
+                  const Renderer<SampleType, AccumulatorType>::PreparedSegment&
+                      prepared,
+                  const string& format,
+                  const string& output_path) {
+  RenderSink<SampleType>* sink = NULL;
+  int raw_file = -1;
+  if (format == "raw") {
+    raw_file = open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (raw_file < 0) {
+      return false;
+    }
+    sink = new RawPCMSink<SampleType>(raw_file);
+  } else {
+    sink = new SoundFileSink<SampleType>(
+        output_path, format == "flac" ? SF_FORMAT_FLAC : SF_FORMAT_WAV);
+  }
+  bool rendered;
+  {
+    BufferedSink<SampleType> buffered_sink(sink);
+    rendered = renderer.Render(prepared, &buffered_sink);
+  }
+  delete sink;
+  if (raw_file >= 0) {
+    rendered = close(raw_file) == 0 && rendered;
+  }
+  return rendered;
+}
+
+RenderServer::RenderServer(int worker_count,
+                           size_t max_cache_size,
+                           size_t max_text_size)
+    : worker_count_(worker_count), max_cache_size_(max_cache_size),
+      max_text_size_(max_text_size), listen_socket_(-1), stopping_(false),
+      connection_count_(0), cache_size_(0), job_count_(0),
+      failed_job_count_(0), cache_hit_count_(0), cache_miss_count_(0) {
+  assert(worker_count_ > 0);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&job_queued_, NULL);
+  pthread_cond_init(&job_finished_, NULL);
+  pthread_cond_init(&connection_finished_, NULL);
+}
+
+RenderServer::~RenderServer() {
+  assert(jobs_.empty());
+  for (map<string, CacheEntry*>::iterator entry = cache_.begin();
+       entry != cache_.end(); ++entry) {
+    delete entry->second;
+  }
+  pthread_cond_destroy(&connection_finished_);
+  pthread_cond_destroy(&job_finished_);
+  pthread_cond_destroy(&job_queued_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+bool RenderServer::Serve(const string& socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+  // A socket left behind by a previous server is replaced, but nothing else.
+  struct stat socket_stat;
+  if (lstat(socket_path.c_str(), &socket_stat) == 0 &&
+      S_ISSOCK(socket_stat.st_mode)) {
+    unlink(socket_path.c_str());
+  }
+  listen_socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_socket_ < 0) {
+    return false;
+  }
+  if (bind(listen_socket_, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_socket_, SOMAXCONN) != 0) {
+    close(listen_socket_);
+    listen_socket_ = -1;
+    return false;
+  }
+
+  vector<pthread_t> workers(worker_count_);
+  for (int worker = 0; worker < worker_count_; ++worker) {
+    int error = pthread_create(&workers[worker], NULL, WorkerThread, this);
+    assert(!error);
+  }
+
+  // SHUTDOWN requests shut the listening socket down, which ends the wait for
+  // connections.
+  while (true) {
+    int connection = accept(listen_socket_, NULL, NULL);
+    pthread_mutex_lock(&mutex_);
+    bool stopping = stopping_;
+    pthread_mutex_unlock(&mutex_);
+    if (connection < 0) {
+      if (!stopping && (errno == EINTR || errno == ECONNABORTED)) {
+        continue;
+      }
+      if (!stopping) {
+        cerr << "Accepting connections failed: " << strerror(errno) << endl;
+      }
+      break;
+    }
+    if (stopping) {
+      close(connection);
+      break;
+    }
+
+    pthread_mutex_lock(&mutex_);
+    ++connection_count_;
+    pthread_mutex_unlock(&mutex_);
+    ServerConnection* server_connection = new ServerConnection;
+    server_connection->server = this;
+    server_connection->socket = connection;
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, ConnectionThread,
+                               server_connection);
+    assert(!error);
+    pthread_detach(thread);
+  }
+
+  // Open connections finish their jobs before the workers are stopped.
+  pthread_mutex_lock(&mutex_);
+  stopping_ = true;
+  while (connection_count_ > 0) {
+    pthread_cond_wait(&connection_finished_, &mutex_);
+  }
+  pthread_cond_broadcast(&job_queued_);
+  pthread_mutex_unlock(&mutex_);
+  for (int worker = 0; worker < worker_count_; ++worker) {
+    pthread_join(workers[worker], NULL);
+  }
+  close(listen_socket_);
+  listen_socket_ = -1;
+  unlink(socket_path.c_str());
+  return true;
+}
+
+void* RenderServer::ConnectionThread(void* connection) {
+  ServerConnection* server_connection =
+      static_cast<ServerConnection*>(connection);
+  RenderServer* server = server_connection->server;
+  server->HandleConnection(server_connection->socket);
+  close(server_connection->socket);
+  delete server_connection;
+
+  pthread_mutex_lock(&server->mutex_);
+  --server->connection_count_;
+  pthread_cond_signal(&server->connection_finished_);
+  pthread_mutex_unlock(&server->mutex_);
+  return NULL;
+}
+
+void* RenderServer::WorkerThread(void* server) {
+  RenderServer* render_server = static_cast<RenderServer*>(server);
+  ServerRenderer renderer;
+
+  pthread_mutex_lock(&render_server->mutex_);
+  while (true) {
+    while (render_server->jobs_.empty() && !render_server->stopping_) {
+      pthread_cond_wait(&render_server->job_queued_, &render_server->mutex_);
+    }
+    if (render_server->jobs_.empty()) {
+      break;
+    }
+    Job* job = render_server->jobs_.front();
+    render_server->jobs_.pop_front();
+    pthread_mutex_unlock(&render_server->mutex_);
+
+    render_server->RunJob(renderer, job);
+
+    pthread_mutex_lock(&render_server->mutex_);
+    job->done = true;
+    ++render_server->job_count_;
+    if (!job->succeeded) {
+      ++render_server->failed_job_count_;
+    }
+    pthread_cond_broadcast(&render_server->job_finished_);
+  }
+  pthread_mutex_unlock(&render_server->mutex_);
+  return NULL;
+}
+
+void RenderServer::HandleConnection(int connection) {
+  string buffer;
+  if (!ReceiveUntil(connection, 0, &buffer)) {
+    SendAll(connection, "ERROR malformed request\n");
+    return;
+  }
+  size_t line_end = buffer.find('\n');
+  istringstream request(buffer.substr(0, line_end));
+  buffer.erase(0, line_end + 1);
+  string command;
+  request >> command;
+
+  if (command == "STATS") {
+    ostringstream response;
+    pthread_mutex_lock(&mutex_);
+    response << "STATS " << job_count_ << " " << failed_job_count_ << " "
+             << jobs_.size() << " " << cache_.size() << " " << cache_size_
+             << " " << cache_hit_count_ << " " << cache_miss_count_ << "\n";
+    pthread_mutex_unlock(&mutex_);
+    SendAll(connection, response.str());
+    return;
+  }
+  if (command == "SHUTDOWN") {
+    pthread_mutex_lock(&mutex_);
+    stopping_ = true;
+    pthread_mutex_unlock(&mutex_);
+    shutdown(listen_socket_, SHUT_RDWR);
+    SendAll(connection, "OK\n");
+    return;
+  }
+  if (command != "RENDER" && command != "RENDER_TEXT") {
+    SendAll(connection, "ERROR unknown request\n");
+    return;
+  }
+
+  Job job;
+  request >> job.format >> job.output_path;
+  if (command == "RENDER") {
+    request >> ws;
+    getline(request, job.input_path);
+  } else {
+    // The size is checked before the text is received, so that a client
+    // cannot make the server buffer an unbounded score.
+    size_t text_size = 0;
+    if (!(request >> text_size) || text_size == 0) {
+      job.error = "missing score text";
+    } else if (text_size > max_text_size_) {
+      job.error = "score text too large";
+    } else if (ReceiveUntil(connection, text_size, &buffer)) {
+      job.text = buffer.substr(0, text_size);
+    } else {
+      job.error = "missing score text";
+    }
+  }
+  if (job.format != "wav" && job.format != "flac" && job.format != "raw") {
+    job.error = "unknown format";
+  } else if (job.output_path.empty() ||
+             (command == "RENDER" && job.input_path.empty())) {
+    job.error = "missing path";
+  }
+  if (!job.error.empty()) {
+    SendAll(connection, "ERROR " + job.error + "\n");
+    return;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  if (stopping_) {
+    pthread_mutex_unlock(&mutex_);
+    SendAll(connection, "ERROR server is shutting down\n");
+    return;
+  }
+  job.queue_depth = jobs_.size();
+  job.submit_time = MonotonicSeconds();
+  jobs_.push_back(&job);
+  pthread_cond_signal(&job_queued_);
+  while (!job.done) {
+    pthread_cond_wait(&job_finished_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+
+  ostringstream log;
+  ostringstream response;
+  log.setf(ios::fixed);
+  log.precision(3);
+  response.setf(ios::fixed);
+  response.precision(3);
+  double queued = (job.start_time - job.submit_time) * 1000.0;
+  double prepare = (job.prepared_time - job.start_time) * 1000.0;
+  double render = (job.finish_time - job.prepared_time) * 1000.0;
+  double total = (job.finish_time - job.submit_time) * 1000.0;
+  log << "Job [" << job.output_path << "]: "
+      << (job.succeeded ? "done" : job.error) << ", queue depth "
+      << job.queue_depth << ", queued " << queued << " ms, prepare "
+      << prepare << " ms" << (job.cached ? " (cached)" : "") << ", render "
+      << render << " ms, total " << total << " ms\n";
+  cerr << log.str();
+  if (job.succeeded) {
+    response << "OK " << job.queue_depth << " " << queued << " " << prepare
+             << " " << render << " " << total << " " << job.cached << "\n";
+  } else {
+    response << "ERROR " << job.error << "\n";
+  }
+  SendAll(connection, response.str());
+}
+
+void RenderServer::RunJob(const ServerRenderer& renderer, Job* job) {
+  job->start_time = MonotonicSeconds();
+  CacheEntry* entry = AcquireScore(renderer, job);
+  job->prepared_time = MonotonicSeconds();
+  if (entry != NULL) {
+    job->succeeded = RenderToFile(renderer, entry->prepared, job->format,
+                                  job->output_path);
+    if (!job->succeeded) {
+      job->error = "rendering to " + job->output_path + " failed";
+    }
+    ReleaseScore(entry);
+  }
+  job->finish_time = MonotonicSeconds();
+}
+
+RenderServer::CacheEntry* RenderServer::AcquireScore(
+    const ServerRenderer& renderer,
+    Job* job) {
+  // Files are identified by their path and modification, so edited scores are
+  // prepared again.
+  int input_file = -1;
+  string key;
+  if (job->input_path.empty()) {
+    key = "text:" + job->text;
+  } else {
+    struct stat input_stat;
+    input_file = open(job->input_path.c_str(), O_RDONLY);
+    if (input_file < 0 || fstat(input_file, &input_stat) != 0) {
+      if (input_file >= 0) {
+        close(input_file);
+      }
+      job->error = "cannot open " + job->input_path;
+      return NULL;
+    }
+    ostringstream file_key;
+    file_key << "file:" << input_stat.st_mtime << ":"
+             << input_stat.st_mtim.tv_nsec << ":" << input_stat.st_size << ":"
+             << job->input_path;
+    key = file_key.str();
+  }
+
+  pthread_mutex_lock(&mutex_);
+  map<string, CacheEntry*>::iterator cached = cache_.find(key);
+  if (cached != cache_.end()) {
+    CacheEntry* entry = cached->second;
+    ++entry->users;
+    cache_order_.splice(cache_order_.end(), cache_order_, entry->order);
+    ++cache_hit_count_;
+    pthread_mutex_unlock(&mutex_);
+    if (input_file >= 0) {
+      close(input_file);
+    }
+    job->cached = true;
+    return entry;
+  }
+  ++cache_miss_count_;
+  pthread_mutex_unlock(&mutex_);
+
+  // Scores are parsed and prepared without holding the lock. Should two jobs
+  // prepare the same score at once, the first to finish is kept.
+  SegmentCollector<SampleType> collector;
+  bool parsed = input_file >= 0
+      ? ParseScoreFile(input_file, &collector, &job->error)
+      : ParseScore(job->text, &collector, &job->error);
+  if (input_file >= 0) {
+    close(input_file);
+  }
+  if (!parsed) {
+    return NULL;
+  }
+  CacheEntry* entry = new CacheEntry;
+  entry->key = key;
+  renderer.Prepare(collector.segment(), &entry->prepared);
+  entry->size = entry->prepared.memory_size() + key.size();
+  entry->users = 1;
+
+  pthread_mutex_lock(&mutex_);
+  cached = cache_.find(key);
+  if (cached != cache_.end()) {
+    delete entry;
+    entry = cached->second;
+    ++entry->users;
+    cache_order_.splice(cache_order_.end(), cache_order_, entry->order);
+  } else {
+    cache_[key] = entry;
+    entry->order = cache_order_.insert(cache_order_.end(), entry);
+    cache_size_ += entry->size;
+    TrimCache();
+  }
+  pthread_mutex_unlock(&mutex_);
+  return entry;
+}
+
+void RenderServer::ReleaseScore(CacheEntry* entry) {
+  pthread_mutex_lock(&mutex_);
+  assert(entry->users > 0);
+  --entry->users;
+  TrimCache();
+  pthread_mutex_unlock(&mutex_);
+}
+
+void RenderServer::TrimCache() {
+  list<CacheEntry*>::iterator entry = cache_order_.begin();
+  while (cache_size_ > max_cache_size_ && entry != cache_order_.end()) {
+    if ((*entry)->users > 0) {
+      ++entry;
+      continue;
+    }
+    cache_size_ -= (*entry)->size;
+    cache_.erase((*entry)->key);
+    delete *entry;
+    entry = cache_order_.erase(entry);
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef RENDER_SERVER_H_
+#define RENDER_SERVER_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "yystype.h"
+
+// RenderServer renders scores on request from clients connecting to a local
+// Unix socket, on a fixed pool of worker threads. Scores are parsed and
+// prepared (see Renderer::Prepare()) at most once while they stay in a cache
+// shared by all jobs, which is bounded by memory use and evicts the least
+// recently used scores first. Each connection carries a single request line:
+//
+//   RENDER <format> <output path> <input path>
+//   RENDER_TEXT <format> <output path> <byte count>
+//   STATS
+//   SHUTDOWN
+//
+// RENDER_TEXT is followed by the .mae text itself, of at most the maximum text
+// size of the server. Formats are wav, flac and
+// raw, as for maestro, and the output path may not contain spaces. Render
+// requests are answered once the job has finished, with
+//
+//   OK <queue depth> <queued ms> <prepare ms> <render ms> <total ms> <cached>
+//
+// where the queue depth counts the jobs waiting before this one, or with
+// "ERROR <description>". STATS is answered with
+//
+//   STATS <jobs> <failed jobs> <queue depth> <cached scores> <cache bytes>
+//         <cache hits> <cache misses>
+//
+// on a single line. SHUTDOWN stops the server once running jobs are done.
+class RenderServer {
+ public:
+  RenderServer(int worker_count, size_t max_cache_size, size_t max_text_size);
+  ~RenderServer();
+
+  // Serve requests on a socket created at 'socket_path' until a SHUTDOWN
+  // request. Per-job statistics are logged to stderr. Returns false if the
+  // socket cannot be set up.
+  bool Serve(const std::string& socket_path);
+
+ private:
+  typedef Renderer<SampleType, AccumulatorType> ServerRenderer;
+  typedef ServerRenderer::PreparedSegment PreparedSegment;
+
+  struct CacheEntry;
+  struct Job;
+
+  static void* ConnectionThread(void* connection);
+  static void* WorkerThread(void* server);
+
+  // Read a request from 'connection', execute it and write the response.
+  void HandleConnection(int connection);
+
+  // Render a job on the calling worker thread.
+  void RunJob(const ServerRenderer& renderer, Job* job);
+
+  // Find or prepare the score a job renders. The returned entry must be handed
+  // back to ReleaseScore() once rendered.
+  CacheEntry* AcquireScore(const ServerRenderer& renderer, Job* job);
+  void ReleaseScore(CacheEntry* entry);
+
+  // Evict unused entries until the cache fits. Called with 'mutex_' held.
+  void TrimCache();
+
+  const int worker_count_;
+  const size_t max_cache_size_;  // Bytes.
+  const size_t max_text_size_;   // Bytes of a RENDER_TEXT score.
+  int listen_socket_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t job_queued_;           // Signaled on new jobs and stopping.
+  pthread_cond_t job_finished_;         // Signaled on finished jobs.
+  pthread_cond_t connection_finished_;  // Signaled on closed connections.
+
+  // The following are guarded by 'mutex_'.
+  bool stopping_;
+  int connection_count_;
+  std::deque<Job*> jobs_;
+  std::map<std::string, CacheEntry*> cache_;
+  std::list<CacheEntry*> cache_order_;  // Least recently used first.
+  size_t cache_size_;
+  int64_t job_count_;
+  int64_t failed_job_count_;
+  int64_t cache_hit_count_;
+  int64_t cache_miss_count_;
+};
+
+#endif  // RENDER_SERVER_H_
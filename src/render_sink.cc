@@ -0,0 +1,266 @@
+#include "render_sink.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sndfile.h>
+#include <unistd.h>
+#include <iostream>
+
+using namespace std;
+
+template <typename SampleType>
+sf_count_t WriteSamplesToFile(SNDFILE* sound_file,
+                              const SampleType* samples,
+                              size_t sample_count) {
+  assert(false);  // Writing for samples of this type not defined.
+  return 0;
+}
+
+template < >
+sf_count_t WriteSamplesToFile(SNDFILE* sound_file,
+                              const int* samples,
+                              size_t sample_count) {
+  return sf_write_int(sound_file, samples, sample_count);
+}
+
+template < >
+sf_count_t WriteSamplesToFile(SNDFILE* sound_file,
+                              const float* samples,
+                              size_t sample_count) {
+  return sf_write_float(sound_file, samples, sample_count);
+}
+
+// Conversion to 16 bit PCM. This matches the conversion libsndfile performs
+// when writing full scale samples to a PCM_16 file.
+template <typename SampleType>
+short ToPCM16(SampleType sample) {
+  assert(false);  // Conversion for samples of this type not defined.
+  return 0;
+}
+
+template < >
+short ToPCM16(int sample) {
+  return static_cast<short>(sample >> 16);
+}
+
+template <typename SampleType>
+SoundFileSink<SampleType>::SoundFileSink(const string& path, int format)
+    : path_(path), format_(format), sound_file_(NULL) {
+  assert(!path_.empty());
+}
+
+template <typename SampleType>
+SoundFileSink<SampleType>::~SoundFileSink() {
+  if (sound_file_ != NULL) {
+    sf_close(sound_file_);
+  }
+}
+
+template <typename SampleType>
+bool SoundFileSink<SampleType>::Open(int sample_rate) {
+  assert(sound_file_ == NULL);
+
+  struct SF_INFO sound_format;
+  sound_format.samplerate = sample_rate;
+  sound_format.channels = 1;
+  sound_format.format = format_ | SF_FORMAT_PCM_16;
+  if (sf_format_check(&sound_format) != 1) {
+    cerr << "Unsupported sound file format for " << path_ << endl;
+    return false;
+  }
+  sound_file_ = sf_open(path_.c_str(), SFM_WRITE, &sound_format);
+  if (sound_file_ == NULL) {
+    cerr << "Could not open " << path_ << ": " << sf_strerror(NULL) << endl;
+    return false;
+  }
+  return true;
+}
+
+template <typename SampleType>
+bool SoundFileSink<SampleType>::Write(const SampleType* samples,
+                                      size_t sample_count) {
+  assert(sound_file_ != NULL);
+  return WriteSamplesToFile(sound_file_, samples, sample_count) ==
+      static_cast<sf_count_t>(sample_count);
+}
+
+template <typename SampleType>
+bool SoundFileSink<SampleType>::Close() {
+  assert(sound_file_ != NULL);
+  bool result = !sf_close(sound_file_);
+  sound_file_ = NULL;
+  return result;
+}
+
+template <typename SampleType>
+RawPCMSink<SampleType>::RawPCMSink(int file_descriptor)
+    : file_descriptor_(file_descriptor) {
+  assert(file_descriptor_ >= 0);
+}
+
+template <typename SampleType>
+bool RawPCMSink<SampleType>::Open(int sample_rate) {
+  return true;
+}
+
+template <typename SampleType>
+bool RawPCMSink<SampleType>::Write(const SampleType* samples,
+                                   size_t sample_count) {
+  if (sample_count == 0) {
+    return true;
+  }
+  pcm_buffer_.resize(sample_count);
+  for (size_t sample = 0; sample < sample_count; ++sample) {
+    pcm_buffer_[sample] = ToPCM16(samples[sample]);
+  }
+
+  // Pipes may accept fewer bytes than requested, so keep writing until the
+  // whole chunk has been consumed.
+  const char* data = reinterpret_cast<const char*>(&pcm_buffer_.front());
+  size_t remaining = sample_count * sizeof(short);
+  while (remaining > 0) {
+    ssize_t written = write(file_descriptor_, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    remaining -= written;
+  }
+  return true;
+}
+
+template <typename SampleType>
+bool RawPCMSink<SampleType>::Close() {
+  return true;
+}
+
+template <typename SampleType>
+bool MemorySink<SampleType>::Open(int sample_rate) {
+  sample_rate_ = sample_rate;
+  samples_.clear();
+  return true;
+}
+
+template <typename SampleType>
+bool MemorySink<SampleType>::Write(const SampleType* samples,
+                                   size_t sample_count) {
+  samples_.insert(samples_.end(), samples, samples + sample_count);
+  return true;
+}
+
+template <typename SampleType>
+bool MemorySink<SampleType>::Close() {
+  return true;
+}
+
+template <typename SampleType>
+BufferedSink<SampleType>::BufferedSink(RenderSink<SampleType>* sink)
+    : sink_(sink), writer_running_(false), back_buffer_full_(false),
+      closing_(false), failed_(false) {
+  assert(sink_ != NULL);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&buffer_changed_, NULL);
+}
+
+template <typename SampleType>
+BufferedSink<SampleType>::~BufferedSink() {
+  assert(!writer_running_);  // Close() must be called after a successful Open().
+  pthread_cond_destroy(&buffer_changed_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+template <typename SampleType>
+bool BufferedSink<SampleType>::Open(int sample_rate) {
+  assert(!writer_running_);
+  if (!sink_->Open(sample_rate)) {
+    return false;
+  }
+  back_buffer_full_ = false;
+  closing_ = false;
+  failed_ = false;
+  if (pthread_create(&writer_thread_, NULL, WriterThread, this)) {
+    sink_->Close();
+    return false;
+  }
+  writer_running_ = true;
+  return true;
+}
+
+template <typename SampleType>
+bool BufferedSink<SampleType>::Write(const SampleType* samples,
+                                     size_t sample_count) {
+  assert(writer_running_);
+  if (sample_count == 0) {
+    return true;
+  }
+  pthread_mutex_lock(&mutex_);
+  while (back_buffer_full_ && !failed_) {
+    pthread_cond_wait(&buffer_changed_, &mutex_);
+  }
+  if (!failed_) {
+    back_buffer_.assign(samples, samples + sample_count);
+    back_buffer_full_ = true;
+    pthread_cond_broadcast(&buffer_changed_);
+  }
+  bool result = !failed_;
+  pthread_mutex_unlock(&mutex_);
+  return result;
+}
+
+template <typename SampleType>
+bool BufferedSink<SampleType>::Close() {
+  assert(writer_running_);
+  pthread_mutex_lock(&mutex_);
+  closing_ = true;
+  pthread_cond_broadcast(&buffer_changed_);
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(writer_thread_, NULL);
+  writer_running_ = false;
+
+  bool closed = sink_->Close();
+  return closed && !failed_;
+}
+
+template <typename SampleType>
+void* BufferedSink<SampleType>::WriterThread(void* buffered_sink) {
+  BufferedSink* sink = static_cast<BufferedSink*>(buffered_sink);
+
+  pthread_mutex_lock(&sink->mutex_);
+  while (true) {
+    while (!sink->back_buffer_full_ && !sink->closing_) {
+      pthread_cond_wait(&sink->buffer_changed_, &sink->mutex_);
+    }
+    if (!sink->back_buffer_full_) {
+      break;  // Closing and fully drained.
+    }
+    // Swap the buffers so that the renderer may refill the back buffer while
+    // the front buffer is written out.
+    sink->front_buffer_.swap(sink->back_buffer_);
+    sink->back_buffer_full_ = false;
+    pthread_cond_broadcast(&sink->buffer_changed_);
+    pthread_mutex_unlock(&sink->mutex_);
+
+    bool written = sink->sink_->Write(&sink->front_buffer_.front(),
+                                      sink->front_buffer_.size());
+
+    pthread_mutex_lock(&sink->mutex_);
+    if (!written) {
+      sink->failed_ = true;
+      pthread_cond_broadcast(&sink->buffer_changed_);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sink->mutex_);
+  return NULL;
+}
+
+// Explicit template instantiations of supported types.
+template class SoundFileSink<int>;
+template class SoundFileSink<float>;  // Full scale at 1.
+template class RawPCMSink<int>;
+template class MemorySink<int>;
+template class BufferedSink<int>;
@@ -0,0 +1,114 @@
+#ifndef RENDER_SINK_H_
+#define RENDER_SINK_H_
+
+#include <pthread.h>
+#include <sndfile.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// RenderSink defines the interface to a consumer of rendered audio. A Renderer
+// opens the sink, writes mono samples to it chunk by chunk in temporal order as
+// soon as each chunk is finished, and then closes it. Return values indicate
+// success.
+template <typename SampleType>
+class RenderSink {
+ public:
+  virtual ~RenderSink() {}
+
+  virtual bool Open(int sample_rate) = 0;  // Samples / second.
+  virtual bool Write(const SampleType* samples, size_t sample_count) = 0;
+  virtual bool Close() = 0;
+};
+
+// Writes 16 bit PCM to a sound file through libsndfile. 'format' is the major
+// libsndfile format, ex. SF_FORMAT_WAV or SF_FORMAT_FLAC.
+template <typename SampleType>
+class SoundFileSink : public RenderSink<SampleType> {
+ public:
+  SoundFileSink(const std::string& path, int format);
+  virtual ~SoundFileSink();
+
+  virtual bool Open(int sample_rate);
+  virtual bool Write(const SampleType* samples, size_t sample_count);
+  virtual bool Close();
+
+ private:
+  std::string path_;
+  int format_;
+  SNDFILE* sound_file_;
+};
+
+// Streams headerless 16 bit native-endian PCM to a file descriptor, such as
+// stdout or a pipe, so that downstream tools may consume audio while the render
+// is still running. The descriptor is not closed by the sink.
+template <typename SampleType>
+class RawPCMSink : public RenderSink<SampleType> {
+ public:
+  explicit RawPCMSink(int file_descriptor);
+  virtual ~RawPCMSink() {}
+
+  virtual bool Open(int sample_rate);
+  virtual bool Write(const SampleType* samples, size_t sample_count);
+  virtual bool Close();
+
+ private:
+  int file_descriptor_;
+  std::vector<short> pcm_buffer_;
+};
+
+// Collects the rendered samples in memory, for embedding the renderer within
+// another program.
+template <typename SampleType>
+class MemorySink : public RenderSink<SampleType> {
+ public:
+  MemorySink() : sample_rate_(0) {}
+  virtual ~MemorySink() {}
+
+  virtual bool Open(int sample_rate);
+  virtual bool Write(const SampleType* samples, size_t sample_count);
+  virtual bool Close();
+
+  int sample_rate() const { return sample_rate_; }
+  const std::vector<SampleType>& samples() const { return samples_; }
+
+ private:
+  int sample_rate_;
+  std::vector<SampleType> samples_;
+};
+
+// Decorates another sink with a double-buffered writer thread. Write() copies
+// the samples into the back buffer and returns immediately unless the writer
+// thread is still busy with the previous write, which lets I/O overlap with
+// synthesis. Failures of the wrapped sink are reported by subsequent calls.
+// Does not take ownership of the wrapped sink.
+template <typename SampleType>
+class BufferedSink : public RenderSink<SampleType> {
+ public:
+  explicit BufferedSink(RenderSink<SampleType>* sink);
+  virtual ~BufferedSink();
+
+  virtual bool Open(int sample_rate);
+  virtual bool Write(const SampleType* samples, size_t sample_count);
+  virtual bool Close();
+
+ private:
+  static void* WriterThread(void* buffered_sink);
+
+  RenderSink<SampleType>* sink_;
+  pthread_t writer_thread_;
+  bool writer_running_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t buffer_changed_;
+
+  // The following are guarded by 'mutex_'.
+  std::vector<SampleType> back_buffer_;
+  bool back_buffer_full_;
+  bool closing_;
+  bool failed_;
+
+  std::vector<SampleType> front_buffer_;  // Owned by the writer thread.
+};
+
+#endif  // RENDER_SINK_H_
@@ -1,111 +1,507 @@
 #include "renderer.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <sndfile.h>
 #include <algorithm>
-#include <cmath>
-#include <deque>
-#include <limits>
 #include <vector>
 
 #include "instrument.h"
+#include "note_schedule.h"
+#include "soft_clip.h"
 
 const float kChunkLength = 1.0f;  // Seconds.
 const int kSampleRate = 22000;    // Samples / second.
 const int kChunkSampleSize = static_cast<int>(kChunkLength * kSampleRate);
 
+// Number of rendered chunks which may be waiting to be written out per worker
+// thread. This bounds memory use when the writer falls behind.
+const int kChunkSlotsPerThread = 2;
+
+// Instances longer than this are expanded into plain notes rather than being
+// synthesized up front, which bounds the memory used by the instance cache.
+const float kMaxInstanceLength = 60.0f;  // Seconds.
+
+// The notes and instances overlapping a chunk, as indices into those rendered.
+template <typename SampleType, typename AccumulatorType>
+struct Renderer<SampleType, AccumulatorType>::ChunkContents {
+  std::vector<size_t> notes;
+  std::vector<size_t> instances;
+};
+
+// Per-thread state used while rendering chunks.
+template <typename SampleType, typename AccumulatorType>
+struct Renderer<SampleType, AccumulatorType>::ChunkScratch {
+  ChunkScratch() : accumulator_buffer(kChunkSampleSize) {}
+
+  ToneGeneratorInstrument<SampleType, AccumulatorType> instrument;
+  VoiceBatch voices;
+  std::vector<AccumulatorType> accumulator_buffer;
+};
+
+// Schedule sweeps along with the chunks so that each chunk only visits the
+// notes and instance occurrences which overlap it. Only Advance() modifies the
+// schedule; the notes and instances themselves are immutable.
+template <typename SampleType, typename AccumulatorType>
+class Renderer<SampleType, AccumulatorType>::Schedule {
+ public:
+  // 'notes' and 'instances' must be sorted by onset, and 'notes' must outlive
+  // the schedule.
+  Schedule(const NoteSpan& notes,
+           const std::vector<SegmentInstance>& instances)
+      : notes_(notes),
+        instances_(instances),
+        instance_start_samples_(instances.size()),
+        instance_length_samples_(instances.size()),
+        note_schedule_(notes_.start_samples, notes_.length_samples,
+                       notes_.size),
+        instance_schedule_(NULL, NULL, 0) {
+    for (size_t instance = 0; instance < instances_.size(); ++instance) {
+      instance_start_samples_[instance] = instances_[instance].start_sample();
+      instance_length_samples_[instance] =
+          instances_[instance].length_samples();
+    }
+    if (!instances_.empty()) {
+      instance_schedule_ = NoteSchedule(&instance_start_samples_.front(),
+                                        &instance_length_samples_.front(),
+                                        instances_.size());
+    }
+  }
+
+  const NoteSpan& notes() const { return notes_; }
+  const std::vector<SegmentInstance>& instances() const { return instances_; }
+
+  void Advance(int64_t start, int64_t end, ChunkContents* contents) {
+    note_schedule_.Advance(start, end, &contents->notes);
+    instance_schedule_.Advance(start, end, &contents->instances);
+  }
+
+ private:
+  NoteSpan notes_;
+  std::vector<SegmentInstance> instances_;  // Sorted by onset.
+  std::vector<int64_t> instance_start_samples_;
+  std::vector<int64_t> instance_length_samples_;
+  NoteSchedule note_schedule_;
+  NoteSchedule instance_schedule_;
+};
+
+// ChunkQueue hands out chunks, along with the notes overlapping them, to the
+// worker threads and collects their results in a ring of output slots. Chunk n
+// is always rendered into slot n % slots.size(), and a worker may only claim a
+// chunk once the writer has released the slot it maps to.
+template <typename SampleType, typename AccumulatorType>
+struct Renderer<SampleType, AccumulatorType>::ChunkQueue {
+  struct Slot {
+    Slot() : ready(false), sample_buffer(kChunkSampleSize) {}
+
+    bool ready;
+    ChunkContents contents;
+    std::vector<SampleType> sample_buffer;
+  };
+
+  ChunkQueue(const Renderer* r, const std::vector<InstanceAudio>* audio,
+             Schedule* s, int64_t count, int slot_count)
+      : renderer(r), instance_audio(audio), chunk_count(count), schedule(s),
+        next_chunk(0), written_chunks(0), slots(slot_count) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&slot_released, NULL);
+    pthread_cond_init(&chunk_rendered, NULL);
+  }
+  ~ChunkQueue() {
+    pthread_cond_destroy(&chunk_rendered);
+    pthread_cond_destroy(&slot_released);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  const Renderer* renderer;
+  const std::vector<InstanceAudio>* instance_audio;
+  const int64_t chunk_count;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t slot_released;   // Signaled by the writer.
+  pthread_cond_t chunk_rendered;  // Signaled by the workers.
+
+  // The following are guarded by 'mutex'.
+  Schedule* schedule;
+  int64_t next_chunk;
+  int64_t written_chunks;
+  std::vector<Slot> slots;
+};
+
+template <typename SampleType, typename AccumulatorType>
+Renderer<SampleType, AccumulatorType>::PreparedSegment::PreparedSegment()
+    : notes(kSampleRate), length_samples(0) {
+}
+
+template <typename SampleType, typename AccumulatorType>
+size_t
+Renderer<SampleType, AccumulatorType>::PreparedSegment::memory_size() const {
+  size_t size = sizeof(*this) +
+      notes.size() * (2 * sizeof(int64_t) + 2 * sizeof(float)) +
+      instances.size() * sizeof(SegmentInstance);
+  for (size_t content = 0; content < instance_audio.size(); ++content) {
+    size += instance_audio[content].size() * sizeof(AccumulatorType);
+  }
+  return size;
+}
+
+template <typename SampleType, typename AccumulatorType>
+Renderer<SampleType, AccumulatorType>::Renderer(int thread_count)
+    : thread_count_(thread_count) {
+  assert(thread_count_ > 0);
+}
+
 template <typename SampleType, typename AccumulatorType>
 void Renderer<SampleType, AccumulatorType>::WriteWAV(
     const Segment<SampleType>& segment,
     const std::string& target_path) {
   assert(!target_path.empty());
+  SoundFileSink<SampleType> sink(target_path, SF_FORMAT_WAV);
+  bool rendered = Render(segment, &sink);
+  assert(rendered);
+}
+
+template <typename SampleType, typename AccumulatorType>
+bool Renderer<SampleType, AccumulatorType>::Render(
+    const Segment<SampleType>& segment,
+    RenderSink<SampleType>* sink) {
+  PreparedSegment prepared;
+  Prepare(segment, &prepared);
+  return Render(prepared, sink);
+}
 
-  struct SF_INFO sound_format;
-  sound_format.samplerate = kSampleRate;
-  sound_format.channels = 1;
-  sound_format.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
-  assert(sf_format_check(&sound_format) == 1);
-  SNDFILE* sound_file = sf_open(target_path.c_str(), SFM_WRITE, &sound_format);
-  assert(sound_file);
+template <typename SampleType, typename AccumulatorType>
+void Renderer<SampleType, AccumulatorType>::Prepare(
+    const Segment<SampleType>& segment,
+    PreparedSegment* prepared) const {
+  assert(prepared != NULL);
 
-  // In order to simplify the rendering process later, we want to sort the notes
-  // here by their temporal position in the result.
-  std::deque<Note> notes(segment.notes().begin(), segment.notes().end());
-  std::sort(notes.begin(), notes.end());
+  // Instanced segments (repetitions and named segments) are synthesized once
+  // here, and their audio is mixed in at every occurrence. Overly long ones are
+  // expanded into plain notes instead.
+  NoteTable* notes = &prepared->notes;
+  std::vector<Segment<SampleType> > contents;
+  std::vector<SegmentInstance> instances;
+  segment.FlattenInstances(notes, &contents, &instances);
+  std::vector<InstanceAudio>* instance_audio = &prepared->instance_audio;
+  instance_audio->assign(contents.size(), InstanceAudio());
+  prepared->instances.clear();
+  ChunkScratch scratch;
+  for (std::vector<SegmentInstance>::const_iterator instance =
+           instances.begin(); instance != instances.end(); ++instance) {
+    const Segment<SampleType>& content = contents[instance->content()];
+    if (content.length() > kMaxInstanceLength) {
+      NoteSpan content_notes = content.notes(kSampleRate).span();
+      for (size_t note = 0; note < content_notes.size; ++note) {
+        notes->Add(instance->start_sample() + content_notes.start_samples[note],
+                   content_notes.length_samples[note],
+                   content_notes.frequencies[note],
+                   content_notes.amplitudes[note]);
+      }
+      continue;
+    }
+    InstanceAudio* audio = &(*instance_audio)[instance->content()];
+    if (audio->empty()) {
+      RenderInstance(content, &scratch, audio);
+    }
+    prepared->instances.push_back(*instance);
+  }
+  notes->SortByOnset();
+  prepared->length_samples = notes->ToSamples(segment.length());
+}
+
+template <typename SampleType, typename AccumulatorType>
+bool Renderer<SampleType, AccumulatorType>::Render(
+    const PreparedSegment& prepared,
+    RenderSink<SampleType>* sink) const {
+  assert(sink != NULL);
+  Schedule schedule(prepared.notes.span(), prepared.instances);
+  return RenderSchedule(&schedule, prepared.instance_audio,
+                        prepared.length_samples, sink);
+}
+
+template <typename SampleType, typename AccumulatorType>
+bool Renderer<SampleType, AccumulatorType>::Render(
+    const CompiledScore& score,
+    RenderSink<SampleType>* sink) const {
+  assert(sink != NULL);
+  if (score.sample_rate() != kSampleRate) {
+    return false;
+  }
+  Schedule schedule(score.notes(), std::vector<SegmentInstance>());
+  return RenderSchedule(&schedule, std::vector<InstanceAudio>(),
+                        score.length_samples(), sink);
+}
+
+template <typename SampleType, typename AccumulatorType>
+bool Renderer<SampleType, AccumulatorType>::RenderStream(
+    SegmentStream<SampleType>* stream,
+    RenderSink<SampleType>* sink) {
+  assert(stream != NULL);
+  assert(stream->sample_rate() == kSampleRate);
+  assert(sink != NULL);
+  if (!sink->Open(kSampleRate)) {
+    stream->Close();
+    return false;
+  }
+
+  // 'notes' holds the notes taken from the stream which are still sounding,
+  // in onset order. Notes only ever start at or after the stream horizon, so
+  // once it has passed the end of a chunk, the notes overlapping the chunk are
+  // the leading ones starting before that end.
+  NoteTable notes(kSampleRate);
+  int64_t horizon = 0;
+  bool streaming = true;
+  const std::vector<SegmentInstance> no_instances;
+  const std::vector<InstanceAudio> no_instance_audio;
+  ChunkScratch scratch;
+  ChunkContents chunk_contents;
+  std::vector<SampleType> sample_buffer(kChunkSampleSize);
+  bool written = true;
+  bool parsed = true;
+  for (int64_t chunk_start = 0; written; chunk_start += kChunkSampleSize) {
+    int64_t chunk_end = chunk_start + kChunkSampleSize;
+    while (streaming && horizon < chunk_end) {
+      streaming = stream->Next(&notes, &horizon);
+    }
+    // A failed stream is not rendered any further.
+    if (!streaming && stream->failed()) {
+      parsed = false;
+      break;
+    }
+    // Once finished, the horizon is the score length. Chunks are rendered up
+    // to the one containing it, as for other scores.
+    if (!streaming && chunk_start > horizon) {
+      break;
+    }
+
+    notes.RemoveEndedBy(chunk_start);
+    NoteSpan span = notes.span();
+    chunk_contents.notes.clear();
+    for (size_t note = 0;
+         note < span.size && span.start_samples[note] < chunk_end; ++note) {
+      chunk_contents.notes.push_back(note);
+    }
+    RenderChunk(span, no_instances, chunk_contents, no_instance_audio,
+                chunk_start, &scratch, &sample_buffer);
+    written = sink->Write(&sample_buffer.front(), kChunkSampleSize);
+  }
+  stream->Close();
+  bool closed = sink->Close();
+  return written && parsed && closed;
+}
+
+template <typename SampleType, typename AccumulatorType>
+int Renderer<SampleType, AccumulatorType>::sample_rate() const {
+  return kSampleRate;
+}
+
+template <typename SampleType, typename AccumulatorType>
+bool Renderer<SampleType, AccumulatorType>::RenderSchedule(
+    Schedule* schedule,
+    const std::vector<InstanceAudio>& instance_audio,
+    int64_t length_samples,
+    RenderSink<SampleType>* sink) const {
+  if (!sink->Open(kSampleRate)) {
+    return false;
+  }
 
   // The following algorithm is as follows: step through time in intervals of
   // kChunkLength. For each time interval chunk, combine instrument samples,
-  // clip, and write out to the target WAV file.
-  std::vector<AccumulatorType> accumulator_buffer(kChunkSampleSize);
-  std::vector<SampleType> sample_buffer(kChunkSampleSize);
-  for (float time = 0; time <= segment.length(); time += kChunkLength) {
-    // Render notes within the chunk range to the accumulator buffer and delete
-    // notes we've passed in time.
-    std::fill(accumulator_buffer.begin(), accumulator_buffer.end(), 0);
-    for (std::deque<Note>::iterator note = notes.begin();
-         note != notes.end(); ++note) {
-      while (note != notes.end() && note->time() + note->length() < time) {
-        note = notes.erase(note);
-      }
-      if (note == notes.end() || note->time() >= time + kChunkLength) {
-        break;
-      }
+  // clip, and write out to the sink.
+  int64_t chunk_count = length_samples / kChunkSampleSize + 1;
+  bool written = true;
+  if (thread_count_ == 1) {
+    ChunkScratch scratch;
+    ChunkContents chunk_contents;
+    std::vector<SampleType> sample_buffer(kChunkSampleSize);
+    for (int64_t chunk = 0; chunk < chunk_count && written; ++chunk) {
+      int64_t chunk_start = chunk * kChunkSampleSize;
+      schedule->Advance(chunk_start, chunk_start + kChunkSampleSize,
+                        &chunk_contents);
+      RenderChunk(schedule->notes(), schedule->instances(), chunk_contents,
+                  instance_audio, chunk_start, &scratch, &sample_buffer);
+      written = sink->Write(&sample_buffer.front(), kChunkSampleSize);
+    }
+    bool closed = sink->Close();
+    return written && closed;
+  }
 
-      int sample_offset =
-          std::max<int>(0, static_cast<int>((time - note->time()) * kSampleRate));
-      float sample_start =
-          std::max(note->time(), time);
-      float sample_end =
-          std::min(note->time() + note->length(), time + kChunkLength);
-      int sample_count =
-          static_cast<int>((sample_end - sample_start) * kSampleRate);
-      assert(sample_count >= 0);
-      ToneGeneratorInstrument<SampleType> instrument;
-      instrument.Generate(note->frequency(),
-                          note->amplitude(),
-                          note->length(),
-                          kSampleRate,
-                          sample_offset,
-                          sample_count,
-                          &sample_buffer.front());
-
-      int accumulator_offset =
-          std::max<int>(0, static_cast<int>((note->time() - time) * kSampleRate));
-      for (int sample_index = 0; sample_index < sample_count; ++sample_index) {
-        accumulator_buffer[accumulator_offset + sample_index] +=
-            sample_buffer[sample_index];
-      }
+  // Otherwise, the workers render chunks in parallel while this thread writes
+  // them out to the sink in order as they become available.
+  ChunkQueue queue(this, &instance_audio, schedule, chunk_count,
+                   thread_count_ * kChunkSlotsPerThread);
+  std::vector<pthread_t> threads(thread_count_);
+  for (int thread = 0; thread < thread_count_; ++thread) {
+    int error = pthread_create(&threads[thread], NULL, RenderWorker, &queue);
+    assert(!error);
+  }
+  for (int64_t chunk = 0; chunk < chunk_count; ++chunk) {
+    typename ChunkQueue::Slot* slot = &queue.slots[chunk % queue.slots.size()];
+    pthread_mutex_lock(&queue.mutex);
+    while (!slot->ready) {
+      pthread_cond_wait(&queue.chunk_rendered, &queue.mutex);
     }
+    pthread_mutex_unlock(&queue.mutex);
 
-    // Clip / re-sample the accumulator buffer into the sample buffer and then
-    // write the result out to the WAV file.
-    typename std::vector<AccumulatorType>::const_iterator accumulator =
-        accumulator_buffer.begin();
-    typename std::vector<SampleType>::iterator sample = sample_buffer.begin();
-    for (; accumulator != accumulator_buffer.end(); ++accumulator, ++sample) {
-      *sample = SoftClip(*accumulator);
+    // After a failed write the remaining chunks are still drained from the
+    // workers, but no longer passed to the sink.
+    if (written) {
+      written = sink->Write(&slot->sample_buffer.front(), kChunkSampleSize);
+    }
+
+    pthread_mutex_lock(&queue.mutex);
+    slot->ready = false;
+    queue.written_chunks = chunk + 1;
+    pthread_cond_broadcast(&queue.slot_released);
+    pthread_mutex_unlock(&queue.mutex);
+  }
+  for (int thread = 0; thread < thread_count_; ++thread) {
+    pthread_join(threads[thread], NULL);
+  }
+  bool closed = sink->Close();
+  return written && closed;
+}
+
+template <typename SampleType, typename AccumulatorType>
+void* Renderer<SampleType, AccumulatorType>::RenderWorker(void* chunk_queue) {
+  ChunkQueue* queue = static_cast<ChunkQueue*>(chunk_queue);
+  const int slot_count = static_cast<int>(queue->slots.size());
+  ChunkScratch scratch;
+
+  pthread_mutex_lock(&queue->mutex);
+  while (true) {
+    while (queue->next_chunk < queue->chunk_count &&
+           queue->next_chunk >= queue->written_chunks + slot_count) {
+      pthread_cond_wait(&queue->slot_released, &queue->mutex);
+    }
+    if (queue->next_chunk >= queue->chunk_count) {
+      break;
+    }
+    // Chunks are claimed in order, so the schedule only ever moves forward.
+    int64_t chunk = queue->next_chunk++;
+    int64_t chunk_start = chunk * kChunkSampleSize;
+    typename ChunkQueue::Slot* slot = &queue->slots[chunk % slot_count];
+    queue->schedule->Advance(chunk_start, chunk_start + kChunkSampleSize,
+                             &slot->contents);
+    pthread_mutex_unlock(&queue->mutex);
+
+    queue->renderer->RenderChunk(queue->schedule->notes(),
+                                 queue->schedule->instances(), slot->contents,
+                                 *queue->instance_audio, chunk_start,
+                                 &scratch, &slot->sample_buffer);
+
+    pthread_mutex_lock(&queue->mutex);
+    slot->ready = true;
+    pthread_cond_broadcast(&queue->chunk_rendered);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return NULL;
+}
+
+template <typename SampleType, typename AccumulatorType>
+void Renderer<SampleType, AccumulatorType>::RenderInstance(
+    const Segment<SampleType>& content,
+    ChunkScratch* scratch,
+    InstanceAudio* audio) const {
+  NoteTable notes(kSampleRate);
+  std::vector<Segment<SampleType> > contents;
+  std::vector<SegmentInstance> instances;
+  content.FlattenInstances(&notes, &contents, &instances);
+  int sample_count = static_cast<int>(notes.ToSamples(content.length()));
+  audio->assign(std::max(sample_count, 1), 0);
+
+  // Each note is a single voice spanning its whole length.
+  NoteSpan span = notes.span();
+  VoiceBatch* voices = &scratch->voices;
+  voices->Clear();
+  for (size_t note = 0; note < span.size; ++note) {
+    int offset = static_cast<int>(
+        std::min<int64_t>(sample_count, span.start_samples[note]));
+    int count = static_cast<int>(
+        std::min<int64_t>(sample_count - offset, span.length_samples[note]));
+    voices->Add(span.frequencies[note], span.amplitudes[note],
+                static_cast<int>(span.length_samples[note]), 0, offset, count);
+  }
+  scratch->instrument.MixVoices(*voices, kSampleRate, &audio->front());
+
+  // Nested instances are synthesized once per enclosing instance.
+  std::vector<InstanceAudio> nested_audio(contents.size());
+  for (std::vector<SegmentInstance>::const_iterator instance =
+           instances.begin(); instance != instances.end(); ++instance) {
+    InstanceAudio* nested = &nested_audio[instance->content()];
+    if (nested->empty()) {
+      RenderInstance(contents[instance->content()], scratch, nested);
+    }
+    int offset = static_cast<int>(
+        std::min<int64_t>(sample_count, instance->start_sample()));
+    int count = std::min<int>(sample_count - offset, nested->size());
+    for (int sample = 0; sample < count; ++sample) {
+      (*audio)[offset + sample] += (*nested)[sample];
     }
-    assert(sf_write_int(sound_file, &sample_buffer.front(), kChunkSampleSize) ==
-           kChunkSampleSize);
   }
-  assert(!sf_close(sound_file));
 }
 
 template <typename SampleType, typename AccumulatorType>
-SampleType Renderer<SampleType, AccumulatorType>::SoftClip(
-    AccumulatorType sample) const {
-  static const AccumulatorType kMax = std::numeric_limits<SampleType>::max();
+void Renderer<SampleType, AccumulatorType>::RenderChunk(
+    const NoteSpan& notes,
+    const std::vector<SegmentInstance>& instances,
+    const ChunkContents& contents,
+    const std::vector<InstanceAudio>& instance_audio,
+    int64_t chunk_start,
+    ChunkScratch* scratch,
+    std::vector<SampleType>* sample_buffer) const {
+  const int64_t chunk_end = chunk_start + kChunkSampleSize;
 
-  double d_sample =
-      std::abs(static_cast<double>(sample) / static_cast<double>(kMax));
-  double magnitude =
-      -std::log(std::exp(-d_sample) + 1.0) +
-      std::log(std::exp(0.0) + 1.0);
-  magnitude *= static_cast<double>(kMax);
+  // Collect the portions of the notes within the chunk range into a batch of
+  // voices, which the instrument then mixes into the accumulator buffer.
+  VoiceBatch* voices = &scratch->voices;
+  voices->Clear();
+  for (std::vector<size_t>::const_iterator note = contents.notes.begin();
+       note != contents.notes.end(); ++note) {
+    int64_t note_start = notes.start_samples[*note];
+    int64_t note_end = note_start + notes.length_samples[*note];
+    int64_t first = std::max(note_start, chunk_start);
+    int64_t last = std::min(note_end, chunk_end);
+    assert(first <= last);
+    voices->Add(notes.frequencies[*note], notes.amplitudes[*note],
+                static_cast<int>(notes.length_samples[*note]),
+                static_cast<int>(first - note_start),
+                static_cast<int>(first - chunk_start),
+                static_cast<int>(last - first));
+  }
+
+  std::vector<AccumulatorType>* accumulator_buffer =
+      &scratch->accumulator_buffer;
+  std::fill(accumulator_buffer->begin(), accumulator_buffer->end(), 0);
+  scratch->instrument.MixVoices(*voices, kSampleRate,
+                                &accumulator_buffer->front());
+
+  // Instances are mixed in from their pre-rendered audio, positioned exactly
+  // like notes.
+  for (std::vector<size_t>::const_iterator instance_index =
+           contents.instances.begin();
+       instance_index != contents.instances.end(); ++instance_index) {
+    const SegmentInstance& instance = instances[*instance_index];
+    const InstanceAudio& audio = instance_audio[instance.content()];
+    int64_t instance_start = instance.start_sample();
+    int64_t instance_end = instance_start +
+        std::min<int64_t>(instance.length_samples(), audio.size());
+    int64_t first = std::max(instance_start, chunk_start);
+    int64_t last = std::min(instance_end, chunk_end);
+    if (first >= last) {
+      continue;
+    }
+    const AccumulatorType* source = &audio[first - instance_start];
+    AccumulatorType* target = &(*accumulator_buffer)[first - chunk_start];
+    for (int64_t sample = 0; sample < last - first; ++sample) {
+      target[sample] += source[sample];
+    }
+  }
 
-  SampleType result =
-      static_cast<SampleType>(sample < 0 ? -magnitude : magnitude);
-  return result;
+  // Clip / re-sample the accumulator buffer into the sample buffer.
+  SoftClipSamples(&accumulator_buffer->front(), accumulator_buffer->size(),
+                  &sample_buffer->front());
 }
 
 // Explicit template instantiations of supported types.
@@ -1,18 +1,103 @@
 #ifndef RENDERER_H_
 #define RENDERER_H_
 
+#include <stdint.h>
 #include <string>
+#include <vector>
 
+#include "compiled_score.h"
+#include "note_table.h"
+#include "render_sink.h"
 #include "segment.h"
+#include "segment_stream.h"
 
 template <typename SampleType, typename AccumulatorType>
 class Renderer {
  public:
+  // A segment flattened into notes, with the audio of its instances
+  // synthesized up front. Prepared segments may be rendered any number of
+  // times, from any number of threads at once. See Prepare().
+  struct PreparedSegment {
+    PreparedSegment();
+
+    // Approximate memory used, in bytes.
+    size_t memory_size() const;
+
+    NoteTable notes;  // Notes outside of instances, sorted by onset.
+    std::vector<SegmentInstance> instances;  // Sorted by onset.
+    std::vector<std::vector<AccumulatorType> > instance_audio;  // By content.
+    int64_t length_samples;
+  };
+
+  // Chunks are synthesized by 'thread_count' worker threads while the calling
+  // thread writes them out in order. The output does not depend on the number
+  // of threads used.
+  explicit Renderer(int thread_count = 1);
+
+  // Render the segment to the sink, which is opened and closed by this call.
+  // Returns false if the sink reported an error.
+  bool Render(const Segment<SampleType>& segment,
+              RenderSink<SampleType>* sink);
+
+  // Do all the work of rendering a segment which does not depend on the sink,
+  // so that it may be rendered repeatedly without repeating it.
+  void Prepare(const Segment<SampleType>& segment,
+               PreparedSegment* prepared) const;
+  bool Render(const PreparedSegment& prepared,
+              RenderSink<SampleType>* sink) const;
+
+  // Render a compiled score straight from its note columns. Also returns false
+  // if the score was compiled for a different sample rate.
+  bool Render(const CompiledScore& score, RenderSink<SampleType>* sink) const;
+
+  // Render a score while it is still being parsed, holding only the notes of
+  // the stream which have not finished sounding yet. Chunks are synthesized by
+  // the calling thread as soon as the stream has moved past them, and the
+  // stream is closed on return. The stream must be at sample_rate(). Returns
+  // false, with the sink closed, if the stream failed.
+  bool RenderStream(SegmentStream<SampleType>* stream,
+                    RenderSink<SampleType>* sink);
+
+  // Samples / second of the rendered audio, and of the scores it can render.
+  int sample_rate() const;
+
   void WriteWAV(const Segment<SampleType>& segment,
                 const std::string& target_path);
 
  private:
-  SampleType SoftClip(AccumulatorType sample) const;
+  typedef std::vector<AccumulatorType> InstanceAudio;
+
+  struct ChunkContents;
+  struct ChunkQueue;
+  struct ChunkScratch;
+  class Schedule;
+
+  // Render the chunks covering 'length_samples' samples of the scheduled notes
+  // and instances to the sink, which is opened and closed by this call.
+  bool RenderSchedule(Schedule* schedule,
+                      const std::vector<InstanceAudio>& instance_audio,
+                      int64_t length_samples,
+                      RenderSink<SampleType>* sink) const;
+
+  static void* RenderWorker(void* chunk_queue);
+
+  // Synthesize an instanced segment in its entirety into 'audio'.
+  void RenderInstance(const Segment<SampleType>& content,
+                      ChunkScratch* scratch,
+                      InstanceAudio* audio) const;
+
+  // Render the 'contents' of the chunk starting at 'chunk_start', which index
+  // 'notes' and 'instances', into 'sample_buffer', using the calling thread's
+  // 'scratch' state.
+  void RenderChunk(const NoteSpan& notes,
+                   const std::vector<SegmentInstance>& instances,
+                   const ChunkContents& contents,
+                   const std::vector<InstanceAudio>& instance_audio,
+                   int64_t chunk_start,
+                   ChunkScratch* scratch,
+                   std::vector<SampleType>* sample_buffer) const;
+
+  int thread_count_;
 };
 
 #endif  // RENDERER_H_
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <vector>
+
+#include "note.h"
+#include "render_sink.h"
+#include "renderer.h"
+#include "segment.h"
+
+using namespace std;
+
+typedef int SampleType;
+typedef long long AccumulatorType;
+typedef Renderer<SampleType, AccumulatorType> ScoreRenderer;
+
+// Worker thread counts whose output is compared with that of a single thread.
+const int kThreadCounts[] = { 2, 3, 4, 8 };
+
+Segment<SampleType> MakeNote(float frequency, float seconds) {
+  return Segment<SampleType>(Note(0.2f, frequency, seconds));
+}
+
+// Silence, as a note without amplitude.
+Segment<SampleType> MakeRest(float seconds) {
+  return Segment<SampleType>(Note(0.0f, 0.0f, seconds));
+}
+
+// A score of about 30 chunks mixing every kind of content a chunk may hold:
+// a riff repeated within a repeated instance, long notes overlapping one
+// another and many chunk boundaries, and plain notes and rests between them.
+Segment<SampleType> MakeScore() {
+  Segment<SampleType> riff;
+  for (int note = 0; note < 6; ++note) {
+    riff.Concatenate(MakeNote(220.0f + 55.0f * note, 0.3f));
+  }
+  riff.Repeat(3);
+  Segment<SampleType> phrase = riff;
+  phrase.Union(MakeNote(110.0f, 2.5f));
+  phrase.Repeat(4);
+
+  Segment<SampleType> drones;
+  for (int drone = 0; drone < 12; ++drone) {
+    Segment<SampleType> line = MakeRest(0.37f * drone);
+    line.Concatenate(MakeNote(130.0f + 17.0f * drone, 4.7f));
+    drones.Union(line);
+  }
+
+  Segment<SampleType> melody = MakeRest(1.5f);
+  for (int note = 0; note < 40; ++note) {
+    melody.Concatenate(note % 7 == 6 ? MakeRest(0.25f)
+                                     : MakeNote(330.0f + 11.0f * note, 0.45f));
+  }
+
+  Segment<SampleType> score = phrase;
+  score.Union(drones);
+  score.Union(melody);
+  score.Concatenate(drones);
+  return score;
+}
+
+// Render 'score' with 'thread_count' worker threads into 'samples', through
+// Render() of the segment, or of a prepared segment if 'prepared' is not NULL.
+bool RenderScore(const Segment<SampleType>& score,
+                 const ScoreRenderer::PreparedSegment* prepared,
+                 int thread_count,
+                 vector<SampleType>* samples) {
+  ScoreRenderer renderer(thread_count);
+  MemorySink<SampleType> sink;
+  bool rendered = prepared != NULL ? renderer.Render(*prepared, &sink)
+                                   : renderer.Render(score, &sink);
+  *samples = sink.samples();
+  return rendered;
+}
+
+// Checks that rendering a score on several worker threads writes exactly the
+// samples of a single thread, both from a segment and from a prepared one.
+int main() {
+  Segment<SampleType> score = MakeScore();
+  ScoreRenderer::PreparedSegment prepared;
+  ScoreRenderer(1).Prepare(score, &prepared);
+  printf("%d notes and %d instances, %d samples.\n",
+         int(prepared.notes.size()), int(prepared.instances.size()),
+         int(prepared.length_samples));
+  if (prepared.instances.empty()) {
+    fprintf(stderr, "The score has no instances to render.\n");
+    return 1;
+  }
+
+  for (int use_prepared = 0; use_prepared < 2; ++use_prepared) {
+    const ScoreRenderer::PreparedSegment* source =
+        use_prepared ? &prepared : NULL;
+    const char* source_name = use_prepared ? "prepared segment" : "segment";
+    vector<SampleType> expected;
+    if (!RenderScore(score, source, 1, &expected)) {
+      fprintf(stderr, "Rendering the %s failed.\n", source_name);
+      return 1;
+    }
+    size_t audible_count = 0;
+    for (size_t sample = 0; sample < expected.size(); ++sample) {
+      audible_count += expected[sample] != 0;
+    }
+    if (audible_count < expected.size() / 2) {
+      fprintf(stderr, "The %s renders mostly silence.\n", source_name);
+      return 1;
+    }
+
+    for (size_t count = 0; count < sizeof(kThreadCounts) /
+                                   sizeof(kThreadCounts[0]); ++count) {
+      int thread_count = kThreadCounts[count];
+      vector<SampleType> samples;
+      if (!RenderScore(score, source, thread_count, &samples)) {
+        fprintf(stderr, "Rendering the %s with %d threads failed.\n",
+                source_name, thread_count);
+        return 1;
+      }
+      size_t mismatch = 0;
+      while (mismatch < samples.size() && mismatch < expected.size() &&
+             samples[mismatch] == expected[mismatch]) {
+        ++mismatch;
+      }
+      printf("%s, %d threads: %d samples, %d matching.\n", source_name,
+             thread_count, int(samples.size()), int(mismatch));
+      if (samples.size() != expected.size() || mismatch < samples.size()) {
+        fprintf(stderr, "The %s renders differently with %d threads than "
+                "with one, from sample %d.\n", source_name, thread_count,
+                int(mismatch));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -1,57 +1,299 @@
 #include <assert.h>
+#include <algorithm>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include "segment.h"
 
 using namespace std;
 
+template <typename SampleType>
+struct Segment<SampleType>::Node {
+  enum Type {
+    NOTE,
+    CONCATENATION,  // 'second' starts at the end of 'first'.
+    UNION,          // Both children start at the same time.
+    INSTANCE,       // Shared, instanced content 'first'.
+    REPEAT,         // The INSTANCE 'first', 'repeat_count' times in a row.
+  };
+
+  Node(const Note& n)
+      : type(NOTE), reference_count(1), length(n.length()), note(n),
+        repeat_count(0), notes(NULL) {
+    children[0] = children[1] = NULL;
+  }
+  Node(Type t, Node* first, Node* second = NULL, int count = 0)
+      : type(t), reference_count(1), note(0.0f, 0.0f, 0.0f),
+        repeat_count(count), notes(NULL) {
+    assert(t != NOTE);
+    assert((second != NULL) == (t == CONCATENATION || t == UNION));
+    assert((count > 0) == (t == REPEAT));
+    assert(t != REPEAT || first->type == INSTANCE);
+    children[0] = first;
+    children[1] = second;
+    ++first->reference_count;
+    if (second != NULL) {
+      ++second->reference_count;
+    }
+    switch (type) {
+      case CONCATENATION:
+        length = first->length + second->length;
+        break;
+      case UNION:
+        length = std::max(first->length, second->length);
+        break;
+      case REPEAT:
+        length = first->length * repeat_count;
+        break;
+      default:
+        length = first->length;
+    }
+  }
+  ~Node() { delete notes; }
+
+  Type type;
+  int reference_count;
+  double length;           // Seconds.
+  Note note;               // Valid for NOTE nodes.
+  Node* children[2];       // Valid for all but NOTE nodes.
+  int repeat_count;        // Valid for REPEAT nodes.
+  NoteTable* notes;        // Flattened notes, built on demand.
+};
+
+// Drop a reference to a node, deleting every node no longer referenced. Trees
+// built by the parser are very deep, so this is done without recursion. Most
+// releases delete nothing, and return before allocating the work list.
+template <typename Node>
+void Release(Node* node) {
+  if (node == NULL || --node->reference_count > 0) {
+    return;
+  }
+  vector<Node*> released;
+  for (int child = 0; child < 2; ++child) {
+    if (node->children[child] != NULL) {
+      released.push_back(node->children[child]);
+    }
+  }
+  delete node;
+  while (!released.empty()) {
+    Node* current = released.back();
+    released.pop_back();
+    if (--current->reference_count > 0) {
+      continue;
+    }
+    for (int child = 0; child < 2; ++child) {
+      if (current->children[child] != NULL) {
+        released.push_back(current->children[child]);
+      }
+    }
+    delete current;
+  }
+}
+
+bool InstanceTimeLess(const SegmentInstance& instance_a,
+                      const SegmentInstance& instance_b) {
+  return instance_a < instance_b;
+}
+
+// Collect the notes beneath 'root', which starts at 'root_offset' seconds, into
+// 'notes', offsetting their times by their position in the tree, and sort them
+// by onset. Offsets are accumulated
+// in double precision and only rounded to samples per note. If 'instances' is
+// NULL, instances are expanded in place. Otherwise the outermost instances are
+// not descended into; 'instance_nodes' receives their unique content nodes and
+// 'instances' each occurrence.
+template <typename Node>
+void Flatten(const Node* root, double root_offset, NoteTable* notes,
+             vector<const Node*>* instance_nodes,
+             vector<SegmentInstance>* instances) {
+  map<const Node*, int> content_indices;
+  vector<pair<const Node*, double> > pending;
+  pending.push_back(make_pair(root, root_offset));
+  while (!pending.empty()) {
+    const Node* node = pending.back().first;
+    double offset = pending.back().second;
+    pending.pop_back();
+    switch (node->type) {
+      case Node::NOTE:
+        notes->Add(notes->ToSamples(offset + node->note.time()),
+                   notes->ToSamples(node->note.length()),
+                   node->note.frequency(), node->note.amplitude());
+        break;
+      case Node::CONCATENATION:
+        pending.push_back(make_pair(node->children[1],
+                                    offset + node->children[0]->length));
+        pending.push_back(make_pair(node->children[0], offset));
+        break;
+      case Node::UNION:
+        pending.push_back(make_pair(node->children[1], offset));
+        pending.push_back(make_pair(node->children[0], offset));
+        break;
+      case Node::INSTANCE:
+        if (instances == NULL) {
+          pending.push_back(make_pair(node->children[0], offset));
+        } else {
+          const Node* content = node->children[0];
+          typename map<const Node*, int>::iterator index =
+              content_indices.find(content);
+          if (index == content_indices.end()) {
+            index = content_indices.insert(
+                make_pair(content, instance_nodes->size())).first;
+            instance_nodes->push_back(content);
+          }
+          instances->push_back(
+              SegmentInstance(index->second, notes->ToSamples(offset),
+                              notes->ToSamples(content->length)));
+        }
+        break;
+      case Node::REPEAT:
+        for (int repeat = node->repeat_count - 1; repeat >= 0; --repeat) {
+          pending.push_back(make_pair(
+              node->children[0], offset + node->children[0]->length * repeat));
+        }
+        break;
+    }
+  }
+  notes->SortByOnset();
+  if (instances != NULL) {
+    stable_sort(instances->begin(), instances->end(), InstanceTimeLess);
+  }
+}
+
 template <typename SampleType>
 Segment<SampleType>::Segment()
-    : length_(0.0f) {
+    : root_(NULL) {
 }
 
 template <typename SampleType>
 Segment<SampleType>::Segment(const Segment& segment)
-    : length_(segment.length_), notes_(segment.notes_) {
+    : root_(segment.root_) {
+  if (root_ != NULL) {
+    ++root_->reference_count;
+  }
+}
+
+template <typename SampleType>
+Segment<SampleType>::Segment(const Note& note)
+    : root_(new Node(note)) {
+}
+
+template <typename SampleType>
+Segment<SampleType>::Segment(Node* root)
+    : root_(root) {
 }
 
 template <typename SampleType>
-Segment<SampleType>::Segment(const Note& note) {
-  length_ = note.length();
-  notes_.push_back(note);
+Segment<SampleType>::~Segment() {
+  Release(root_);
 }
 
 template <typename SampleType>
 void Segment<SampleType>::operator=(const Segment& segment) {
-  length_ = segment.length_;
-  notes_ = segment.notes_;
+  Segment copy(segment);
+  swap(copy);
+}
+
+template <typename SampleType>
+void Segment<SampleType>::swap(Segment& segment) {
+  std::swap(root_, segment.root_);
 }
 
 template <typename SampleType>
-float Segment<SampleType>::length() const {
-  return length_;
+double Segment<SampleType>::length() const {
+  return root_ != NULL ? root_->length : 0.0;
 }
 
 template <typename SampleType>
-const vector<Note>& Segment<SampleType>::notes() const {
-  return notes_;
+const NoteTable& Segment<SampleType>::notes(int sample_rate) const {
+  // Shared by all empty segments, which have no notes at any sample rate.
+  static const NoteTable kNoNotes(1);
+  if (root_ == NULL) {
+    return kNoNotes;
+  }
+  if (root_->notes == NULL || root_->notes->sample_rate() != sample_rate) {
+    delete root_->notes;
+    root_->notes = new NoteTable(sample_rate);
+    Flatten<Node>(root_, 0.0, root_->notes, NULL, NULL);
+  }
+  return *root_->notes;
+}
+
+template <typename SampleType>
+void Segment<SampleType>::AppendNotes(double offset, NoteTable* notes) const {
+  assert(notes != NULL);
+  if (root_ != NULL) {
+    Flatten<Node>(root_, offset, notes, NULL, NULL);
+  }
 }
 
 template <typename SampleType>
 void Segment<SampleType>::Concatenate(const Segment& segment) {
-  notes_.reserve(notes_.size() + segment.notes_.size());
-  for (vector<Note>::const_iterator note = segment.notes_.begin();
-       note != segment.notes_.end(); ++note) {
-    notes_.push_back(*note);
-    notes_.back().set_time(length() + note->time());
+  if (segment.root_ == NULL) {
+    return;
+  }
+  if (root_ == NULL) {
+    *this = segment;
+    return;
   }
-  length_ += segment.length_;
+  Segment result(new Node(Node::CONCATENATION, root_, segment.root_));
+  swap(result);
 }
 
 template <typename SampleType>
 void Segment<SampleType>::Union(const Segment& segment) {
-  notes_.insert(notes_.end(), segment.notes_.begin(), segment.notes_.end());
-  length_ = std::max(length_, segment.length_);
+  if (segment.root_ == NULL) {
+    return;
+  }
+  if (root_ == NULL) {
+    *this = segment;
+    return;
+  }
+  Segment result(new Node(Node::UNION, root_, segment.root_));
+  swap(result);
+}
+
+template <typename SampleType>
+Segment<SampleType> Segment<SampleType>::Instance() const {
+  if (root_ == NULL || root_->type == Node::INSTANCE) {
+    return *this;
+  }
+  return Segment(new Node(Node::INSTANCE, root_));
+}
+
+template <typename SampleType>
+void Segment<SampleType>::Repeat(int count) {
+  assert(count > 0 && count <= kMaxRepeatCount);
+  if (root_ == NULL || count == 1) {
+    return;
+  }
+  Segment instance(Instance());
+  Segment result(new Node(Node::REPEAT, instance.root_, NULL, count));
+  swap(result);
+}
+
+template <typename SampleType>
+void Segment<SampleType>::FlattenInstances(
+    NoteTable* notes,
+    vector<Segment>* contents,
+    vector<SegmentInstance>* instances) const {
+  assert(notes != NULL);
+  assert(contents != NULL);
+  assert(instances != NULL);
+  notes->Clear();
+  contents->clear();
+  instances->clear();
+  if (root_ == NULL) {
+    return;
+  }
+
+  vector<const Node*> content_nodes;
+  Flatten<Node>(root_, 0.0, notes, &content_nodes, instances);
+  for (size_t content = 0; content < content_nodes.size(); ++content) {
+    Node* node = const_cast<Node*>(content_nodes[content]);
+    ++node->reference_count;
+    contents->push_back(Segment(node));
+  }
 }
 
 template <typename SampleType>
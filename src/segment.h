@@ -1,24 +1,77 @@
 #ifndef SEGMENT_H_
 #define SEGMENT_H_
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
 #include "note.h"
+#include "note_table.h"
+
+// An occurrence of an instanced segment within a flattened segment. See
+// Segment::Instance() and Segment::FlattenInstances().
+class SegmentInstance {
+ public:
+  SegmentInstance(int content, int64_t start_sample, int64_t length_samples)
+      : content_(content), start_sample_(start_sample),
+        length_samples_(length_samples) {}
+
+  int content() const { return content_; }
+  int64_t start_sample() const { return start_sample_; }
+  int64_t length_samples() const { return length_samples_; }
+
+  bool operator<(const SegmentInstance& instance) const {
+    return start_sample_ < instance.start_sample_;
+  }
+
+ private:
+  int content_;             // Index into the flattened instance contents.
+  int64_t start_sample_;    // Samples from the start of the flattened segment.
+  int64_t length_samples_;  // Samples.
+};
+
+// Most times a segment may be repeated at once, by Segment::Repeat() and the
+// repeat operator of the .mae language. Renderers expand repetitions in places,
+// so the count is bounded to keep a single term from expanding without limit.
+const int kMaxRepeatCount = 65536;
 
 // Segment represents a sequence of timed, potentially overlapping notes and
 // their associated instruments. The Segment interface is not thread-safe.
+//
+// Segments are persistent trees: concatenation and union create a new node
+// referencing both (reference counted, immutable) operands, so that they, and
+// copying a segment, take constant time no matter how many notes are involved.
+// The tree is flattened into an onset-sorted NoteTable the first time the notes
+// are requested. Offsets are accumulated in double precision seconds and
+// rounded to whole samples once per note, so note placement stays sample
+// accurate however long the segment.
+//
+// Sub-trees may be marked as instances, which are shared by every occurrence
+// (repetitions and named segments) so that the memory used is proportional to
+// the unique content, and which renderers may synthesize once and replay.
 template <typename SampleType>
 class Segment {
  public:
   Segment();
   Segment(const Segment<SampleType>& segment);
   Segment(const Note& note);
+  ~Segment();
 
   void operator=(const Segment<SampleType>& segment);
 
-  float length() const;
-  const std::vector<Note>& notes() const;
+  // Exchange contents with another segment without touching reference counts.
+  void swap(Segment<SampleType>& segment);
+
+  double length() const;  // Seconds.
+
+  // All notes of the segment at 'sample_rate', sorted by onset. Notes starting
+  // at the same sample keep their order of appearance. The table is built on
+  // the first call and shared by all copies of the segment.
+  const NoteTable& notes(int sample_rate) const;
+
+  // Append the notes of the segment, starting 'offset' seconds in, to 'notes'
+  // at its sample rate, and re-sort it by onset. Nothing is cached.
+  void AppendNotes(double offset, NoteTable* notes) const;
 
   // Append another segment to the end of this segment. The segment instance
   // length will be the sum of the length of each.
@@ -28,10 +81,29 @@ class Segment {
   // the length of each.
   void Union(const Segment<SampleType>& segment);
 
+  // Return the segment marked as an instance. All copies of the result, and
+  // every repetition of it, refer to the same instance.
+  Segment<SampleType> Instance() const;
+
+  // Repeat the segment back to back 'count' times, as an instance, from 1 to
+  // kMaxRepeatCount. The segment length is multiplied by 'count'.
+  void Repeat(int count);
+
+  // Flatten the segment without expanding instances, at the sample rate of
+  // 'notes'. 'notes' receives the onset sorted notes which are not part of any
+  // instance. 'contents' receives the unique contents of the outermost
+  // instances, and 'instances' receives each of their occurrences, sorted by
+  // onset. Contents may themselves contain further instances.
+  void FlattenInstances(NoteTable* notes,
+                        std::vector<Segment<SampleType> >* contents,
+                        std::vector<SegmentInstance>* instances) const;
+
  private:
-  float length_;
+  struct Node;
+
+  explicit Segment(Node* root);
 
-  std::vector<Note> notes_;
+  Node* root_;  // NULL for the empty segment.
 };
 
 // Concatenate two segments. The resulting segment length is the sum of the two
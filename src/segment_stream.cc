@@ -0,0 +1,108 @@
+#include "segment_stream.h"
+
+#include <assert.h>
+#include <pthread.h>
+
+template <typename SampleType>
+SegmentStream<SampleType>::SegmentStream(int sample_rate,
+                                         size_t max_queued_notes)
+    : length_(0.0), max_queued_notes_(max_queued_notes),
+      queued_notes_(sample_rate), horizon_(0), finished_(false),
+      failed_(false), closed_(false) {
+  assert(max_queued_notes_ > 0);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&notes_queued_, NULL);
+  pthread_cond_init(&notes_taken_, NULL);
+}
+
+template <typename SampleType>
+SegmentStream<SampleType>::~SegmentStream() {
+  pthread_cond_destroy(&notes_taken_);
+  pthread_cond_destroy(&notes_queued_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+template <typename SampleType>
+void SegmentStream<SampleType>::Consume(const Segment<SampleType>& segment) {
+  // Offsets are accumulated exactly like Segment::Concatenate() lengths, so
+  // notes land on the same samples as when the whole score is flattened.
+  NoteTable notes(sample_rate());
+  segment.AppendNotes(length_, &notes);
+  length_ += segment.length();
+
+  pthread_mutex_lock(&mutex_);
+  assert(!finished_);
+  while (!closed_ && !queued_notes_.empty() &&
+         queued_notes_.size() + notes.size() > max_queued_notes_) {
+    pthread_cond_wait(&notes_taken_, &mutex_);
+  }
+  if (!closed_) {
+    queued_notes_.Append(notes.span());
+    horizon_ = queued_notes_.ToSamples(length_);
+    pthread_cond_signal(&notes_queued_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+template <typename SampleType>
+void SegmentStream<SampleType>::Finish() {
+  pthread_mutex_lock(&mutex_);
+  horizon_ = queued_notes_.ToSamples(length_);
+  finished_ = true;
+  pthread_cond_signal(&notes_queued_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+template <typename SampleType>
+void SegmentStream<SampleType>::Fail() {
+  pthread_mutex_lock(&mutex_);
+  finished_ = true;
+  failed_ = true;
+  pthread_cond_signal(&notes_queued_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+template <typename SampleType>
+bool SegmentStream<SampleType>::failed() const {
+  pthread_mutex_lock(&mutex_);
+  bool failed = failed_;
+  pthread_mutex_unlock(&mutex_);
+  return failed;
+}
+
+template <typename SampleType>
+bool SegmentStream<SampleType>::Next(NoteTable* notes, int64_t* horizon) {
+  assert(notes != NULL);
+  assert(notes->sample_rate() == sample_rate());
+  assert(horizon != NULL);
+
+  pthread_mutex_lock(&mutex_);
+  assert(!closed_);
+  while (!finished_ && queued_notes_.empty()) {
+    pthread_cond_wait(&notes_queued_, &mutex_);
+  }
+  // Only a finished stream may be empty here. The notes of a failed stream
+  // are dropped.
+  if (failed_) {
+    queued_notes_.Clear();
+  }
+  bool more = !queued_notes_.empty();
+  notes->Append(queued_notes_.span());
+  queued_notes_.Clear();
+  *horizon = horizon_;
+  pthread_cond_signal(&notes_taken_);
+  pthread_mutex_unlock(&mutex_);
+  return more;
+}
+
+template <typename SampleType>
+void SegmentStream<SampleType>::Close() {
+  pthread_mutex_lock(&mutex_);
+  closed_ = true;
+  queued_notes_.Clear();
+  pthread_cond_signal(&notes_taken_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+// Explicit template instantiations of supported types.
+template class SegmentStream<int>;
@@ -0,0 +1,86 @@
+#ifndef SEGMENT_STREAM_H_
+#define SEGMENT_STREAM_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "note_table.h"
+#include "segment.h"
+
+// SegmentConsumer receives the top-level segments of a score, in order, as the
+// parser reduces them. The score is their concatenation.
+template <typename SampleType>
+class SegmentConsumer {
+ public:
+  virtual ~SegmentConsumer() {}
+
+  virtual void Consume(const Segment<SampleType>& segment) = 0;
+};
+
+// Concatenates all consumed segments into a single segment.
+template <typename SampleType>
+class SegmentCollector : public SegmentConsumer<SampleType> {
+ public:
+  virtual ~SegmentCollector() {}
+
+  virtual void Consume(const Segment<SampleType>& segment) {
+    segment_.Concatenate(segment);
+  }
+
+  const Segment<SampleType>& segment() const { return segment_; }
+
+ private:
+  Segment<SampleType> segment_;
+};
+
+// SegmentStream hands consumed segments from a parser thread to a render
+// thread as notes, flattened at their offset into the score. Consume() blocks
+// while more than 'max_queued_notes' notes are waiting to be taken, so memory
+// use is bounded by the size of the largest top-level segment rather than that
+// of the score. Instances are expanded.
+template <typename SampleType>
+class SegmentStream : public SegmentConsumer<SampleType> {
+ public:
+  SegmentStream(int sample_rate, size_t max_queued_notes);
+  virtual ~SegmentStream();
+
+  int sample_rate() const { return queued_notes_.sample_rate(); }
+
+  // Producer side. Finish() must be called once all segments are consumed, or
+  // Fail() if the producer fails before, such as on a parse error.
+  virtual void Consume(const Segment<SampleType>& segment);
+  void Finish();
+  void Fail();
+
+  // Consumer side. Wait for more notes and append them to 'notes', which must
+  // be at the stream's sample rate. Every note taken later starts at or after
+  // '*horizon'. Returns false, with '*horizon' set to the length of the whole
+  // score, once the stream is finished and all notes have been taken. Also
+  // returns false, taking no notes, once the stream has failed.
+  bool Next(NoteTable* notes, int64_t* horizon);
+
+  // Consumer side. Whether the producer failed, once Next() returned false.
+  bool failed() const;
+
+  // Consumer side. Stop taking notes; those consumed from now on are dropped
+  // so that the producer never blocks.
+  void Close();
+
+ private:
+  double length_;  // Seconds consumed so far. Only used by the producer.
+
+  mutable pthread_mutex_t mutex_;
+  pthread_cond_t notes_queued_;  // Signaled by the producer.
+  pthread_cond_t notes_taken_;   // Signaled by the consumer.
+
+  // The following are guarded by 'mutex_'.
+  const size_t max_queued_notes_;
+  NoteTable queued_notes_;
+  int64_t horizon_;
+  bool finished_;
+  bool failed_;
+  bool closed_;
+};
+
+#endif  // SEGMENT_STREAM_H_
@@ -0,0 +1,234 @@
+#include "soft_clip.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SOFT_CLIP_AVX2
+#endif
+
+using namespace std;
+
+// The kernels below evaluate the reference curve
+//
+//   f(x) = log(2) - log1p(exp(-d)),  d = min(|x| / kMax, kSaturation)
+//
+// with exp(-d) = 2^k * exp(r) after Cody-Waite range reduction (|r| <= log(2)
+// / 2, degree 12 Taylor polynomial, error < 1e-15) and log1p(e) = 2 atanh(s),
+// s = e / (2 + e) <= 1/3 (odd series through s^25, error < 2e-14). Every kernel
+// performs exactly the same sequence of IEEE double operations, so the choice
+// of kernel never changes the output.
+
+const double kMax = 2147483647.0;  // std::numeric_limits<int>::max().
+const double kInverseMax = 1.0 / kMax;
+const double kSaturation = 40.0;  // exp(-40) vanishes next to log(2).
+const double kLog2 = 6.93147180559945286227e-01;
+const double kLog2High = 6.93147180369123816490e-01;
+const double kLog2Low = 1.90821492927058770002e-10;
+const double kLog2E = 1.44269504088896338700e+00;
+// Adding 1.5 * 2^52 rounds to the nearest integer, which is then left in the
+// low mantissa bits.
+const double kRoundingBias = 6755399441055744.0;
+const long long kExponentBias = 1023;
+
+// 1 / n! for n = 12 down to 0.
+const double kExpCoefficients[] = {
+  2.08767569878681001866e-09, 2.50521083854417202239e-08,
+  2.75573192239858882758e-07, 2.75573192239858925110e-06,
+  2.48015873015873015658e-05, 1.98412698412698412526e-04,
+  1.38888888888888894189e-03, 8.33333333333333321769e-03,
+  4.16666666666666643537e-02, 1.66666666666666657415e-01,
+  5.00000000000000000000e-01, 1.00000000000000000000e+00,
+  1.00000000000000000000e+00,
+};
+const int kExpCoefficientCount =
+    sizeof(kExpCoefficients) / sizeof(kExpCoefficients[0]);
+
+// 2 / (2n + 1) for n = 12 down to 0.
+const double kLog1pCoefficients[] = {
+  8.00000000000000016653e-02, 8.69565217391304323691e-02,
+  9.52380952380952328085e-02, 1.05263157894736836262e-01,
+  1.17647058823529410132e-01, 1.33333333333333331483e-01,
+  1.53846153846153854694e-01, 1.81818181818181823228e-01,
+  2.22222222222222209886e-01, 2.85714285714285698425e-01,
+  4.00000000000000022204e-01, 6.66666666666666629659e-01,
+  2.00000000000000000000e+00,
+};
+const int kLog1pCoefficientCount =
+    sizeof(kLog1pCoefficients) / sizeof(kLog1pCoefficients[0]);
+
+// Accumulators are converted to double in blocks of this many samples.
+const size_t kBlockSize = 256;
+
+typedef void (*SoftClipKernel)(const double* accumulator, size_t sample_count,
+                               int* samples);
+
+void SoftClipScalar(const double* accumulator, size_t sample_count,
+                    int* samples) {
+  for (size_t sample = 0; sample < sample_count; ++sample) {
+    double x = accumulator[sample];
+    double d = std::min(std::abs(x) * kInverseMax, kSaturation);
+    double y = -d;
+
+    double biased = y * kLog2E + kRoundingBias;
+    double k = biased - kRoundingBias;
+    double r = (y - k * kLog2High) - k * kLog2Low;
+    double p = kExpCoefficients[0];
+    for (int c = 1; c < kExpCoefficientCount; ++c) {
+      p = p * r + kExpCoefficients[c];
+    }
+    unsigned long long bits;
+    memcpy(&bits, &biased, sizeof(bits));
+    bits = (bits + kExponentBias) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    double e = p * scale;
+
+    double s = e / (2.0 + e);
+    double z = s * s;
+    double q = kLog1pCoefficients[0];
+    for (int c = 1; c < kLog1pCoefficientCount; ++c) {
+      q = q * z + kLog1pCoefficients[c];
+    }
+    double magnitude = (kLog2 - s * q) * kMax;
+    samples[sample] = static_cast<int>(x < 0 ? -magnitude : magnitude);
+  }
+}
+
+#if defined(__SSE2__)
+void SoftClipSSE2(const double* accumulator, size_t sample_count,
+                  int* samples) {
+  const __m128d sign_mask = _mm_set1_pd(-0.0);
+  const __m128d inverse_max = _mm_set1_pd(kInverseMax);
+  const __m128d saturation = _mm_set1_pd(kSaturation);
+  const __m128d log2e = _mm_set1_pd(kLog2E);
+  const __m128d rounding_bias = _mm_set1_pd(kRoundingBias);
+  const __m128d log2_high = _mm_set1_pd(kLog2High);
+  const __m128d log2_low = _mm_set1_pd(kLog2Low);
+  const __m128i exponent_bias = _mm_set1_epi64x(kExponentBias);
+  const __m128d two = _mm_set1_pd(2.0);
+  const __m128d log2 = _mm_set1_pd(kLog2);
+  const __m128d max = _mm_set1_pd(kMax);
+
+  size_t sample = 0;
+  for (; sample + 2 <= sample_count; sample += 2) {
+    __m128d x = _mm_loadu_pd(accumulator + sample);
+    __m128d sign = _mm_and_pd(x, sign_mask);
+    __m128d d = _mm_min_pd(_mm_mul_pd(_mm_andnot_pd(sign_mask, x), inverse_max),
+                           saturation);
+    __m128d y = _mm_xor_pd(d, sign_mask);
+
+    __m128d biased = _mm_add_pd(_mm_mul_pd(y, log2e), rounding_bias);
+    __m128d k = _mm_sub_pd(biased, rounding_bias);
+    __m128d r = _mm_sub_pd(_mm_sub_pd(y, _mm_mul_pd(k, log2_high)),
+                           _mm_mul_pd(k, log2_low));
+    __m128d p = _mm_set1_pd(kExpCoefficients[0]);
+    for (int c = 1; c < kExpCoefficientCount; ++c) {
+      p = _mm_add_pd(_mm_mul_pd(p, r), _mm_set1_pd(kExpCoefficients[c]));
+    }
+    __m128i bits = _mm_slli_epi64(
+        _mm_add_epi64(_mm_castpd_si128(biased), exponent_bias), 52);
+    __m128d e = _mm_mul_pd(p, _mm_castsi128_pd(bits));
+
+    __m128d s = _mm_div_pd(e, _mm_add_pd(two, e));
+    __m128d z = _mm_mul_pd(s, s);
+    __m128d q = _mm_set1_pd(kLog1pCoefficients[0]);
+    for (int c = 1; c < kLog1pCoefficientCount; ++c) {
+      q = _mm_add_pd(_mm_mul_pd(q, z), _mm_set1_pd(kLog1pCoefficients[c]));
+    }
+    __m128d magnitude = _mm_mul_pd(_mm_sub_pd(log2, _mm_mul_pd(s, q)), max);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(samples + sample),
+                     _mm_cvttpd_epi32(_mm_xor_pd(magnitude, sign)));
+  }
+  SoftClipScalar(accumulator + sample, sample_count - sample, samples + sample);
+}
+#endif  // __SSE2__
+
+#if defined(SOFT_CLIP_AVX2)
+__attribute__((target("avx2")))
+void SoftClipAVX2(const double* accumulator, size_t sample_count,
+                  int* samples) {
+  const __m256d sign_mask = _mm256_set1_pd(-0.0);
+  const __m256d inverse_max = _mm256_set1_pd(kInverseMax);
+  const __m256d saturation = _mm256_set1_pd(kSaturation);
+  const __m256d log2e = _mm256_set1_pd(kLog2E);
+  const __m256d rounding_bias = _mm256_set1_pd(kRoundingBias);
+  const __m256d log2_high = _mm256_set1_pd(kLog2High);
+  const __m256d log2_low = _mm256_set1_pd(kLog2Low);
+  const __m256i exponent_bias = _mm256_set1_epi64x(kExponentBias);
+  const __m256d two = _mm256_set1_pd(2.0);
+  const __m256d log2 = _mm256_set1_pd(kLog2);
+  const __m256d max = _mm256_set1_pd(kMax);
+
+  size_t sample = 0;
+  for (; sample + 4 <= sample_count; sample += 4) {
+    __m256d x = _mm256_loadu_pd(accumulator + sample);
+    __m256d sign = _mm256_and_pd(x, sign_mask);
+    __m256d d = _mm256_min_pd(
+        _mm256_mul_pd(_mm256_andnot_pd(sign_mask, x), inverse_max),
+        saturation);
+    __m256d y = _mm256_xor_pd(d, sign_mask);
+
+    __m256d biased = _mm256_add_pd(_mm256_mul_pd(y, log2e), rounding_bias);
+    __m256d k = _mm256_sub_pd(biased, rounding_bias);
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(y, _mm256_mul_pd(k, log2_high)),
+                              _mm256_mul_pd(k, log2_low));
+    __m256d p = _mm256_set1_pd(kExpCoefficients[0]);
+    for (int c = 1; c < kExpCoefficientCount; ++c) {
+      p = _mm256_add_pd(_mm256_mul_pd(p, r),
+                        _mm256_set1_pd(kExpCoefficients[c]));
+    }
+    __m256i bits = _mm256_slli_epi64(
+        _mm256_add_epi64(_mm256_castpd_si256(biased), exponent_bias), 52);
+    __m256d e = _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+
+    __m256d s = _mm256_div_pd(e, _mm256_add_pd(two, e));
+    __m256d z = _mm256_mul_pd(s, s);
+    __m256d q = _mm256_set1_pd(kLog1pCoefficients[0]);
+    for (int c = 1; c < kLog1pCoefficientCount; ++c) {
+      q = _mm256_add_pd(_mm256_mul_pd(q, z),
+                        _mm256_set1_pd(kLog1pCoefficients[c]));
+    }
+    __m256d magnitude =
+        _mm256_mul_pd(_mm256_sub_pd(log2, _mm256_mul_pd(s, q)), max);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + sample),
+                     _mm256_cvttpd_epi32(_mm256_xor_pd(magnitude, sign)));
+  }
+  SoftClipScalar(accumulator + sample, sample_count - sample, samples + sample);
+}
+#endif  // SOFT_CLIP_AVX2
+
+SoftClipKernel SelectSoftClipKernel() {
+#if defined(SOFT_CLIP_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    return SoftClipAVX2;
+  }
+#endif
+#if defined(__SSE2__)
+  return SoftClipSSE2;
+#else
+  return SoftClipScalar;
+#endif
+}
+
+void SoftClipSamples(const long long* accumulator,
+                     size_t sample_count,
+                     int* samples) {
+  assert(accumulator != NULL || sample_count == 0);
+  assert(samples != NULL || sample_count == 0);
+  static const SoftClipKernel kernel = SelectSoftClipKernel();
+
+  double block[kBlockSize];
+  for (size_t start = 0; start < sample_count; start += kBlockSize) {
+    size_t count = std::min(kBlockSize, sample_count - start);
+    for (size_t sample = 0; sample < count; ++sample) {
+      block[sample] = static_cast<double>(accumulator[start + sample]);
+    }
+    kernel(block, count, samples + start);
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef SOFT_CLIP_H_
+#define SOFT_CLIP_H_
+
+#include <stddef.h>
+#include <cmath>
+#include <limits>
+
+// Reference soft clipping curve. An accumulated sample x is smoothly compressed
+// into the range of SampleType as
+//
+//   kMax * sign(x) * (log(2) - log(1 + exp(-|x| / kMax)))
+//
+// which has slope 1/2 around zero and saturates at log(2) * kMax.
+template <typename SampleType, typename AccumulatorType>
+SampleType SoftClip(AccumulatorType sample) {
+  static const AccumulatorType kMax = std::numeric_limits<SampleType>::max();
+  static const double kLog2 = std::log(2.0);
+
+  double d_sample =
+      std::abs(static_cast<double>(sample) / static_cast<double>(kMax));
+  double magnitude = kLog2 - std::log(std::exp(-d_sample) + 1.0);
+  magnitude *= static_cast<double>(kMax);
+
+  SampleType result =
+      static_cast<SampleType>(sample < 0 ? -magnitude : magnitude);
+  return result;
+}
+
+// Soft clip a chunk of accumulated samples into 'samples'. The generic version
+// applies the reference curve sample by sample.
+template <typename SampleType, typename AccumulatorType>
+void SoftClipSamples(const AccumulatorType* accumulator,
+                     size_t sample_count,
+                     SampleType* samples) {
+  for (size_t sample = 0; sample < sample_count; ++sample) {
+    samples[sample] = SoftClip<SampleType, AccumulatorType>(accumulator[sample]);
+  }
+}
+
+// Vectorized soft clip of 64 bit accumulators to 32 bit samples. AVX2 or SSE2
+// kernels are selected at runtime when available, and otherwise a scalar
+// fallback performing the same arithmetic is used, so all three produce
+// identical output. The curve is evaluated with polynomial approximations of
+// exp and log1p accurate to 2e-14 before scaling by kMax, so results differ
+// from the reference SoftClip by at most one unit, and only for inputs which
+// land on or next to a truncation boundary. Those include small even inputs,
+// whose exact result x / 2 is whole, but which the reference computes just
+// below it, losing precision in log(1 + exp(-d)). See soft_clip_test.
+void SoftClipSamples(const long long* accumulator,
+                     size_t sample_count,
+                     int* samples);
+
+#endif  // SOFT_CLIP_H_
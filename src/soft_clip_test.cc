@@ -0,0 +1,59 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "soft_clip.h"
+
+using namespace std;
+
+// Random accumulators checked, spread over several orders of magnitude.
+const size_t kRandomSampleCount = 1 << 20;
+
+// Fill 'accumulator' with the edges of the curve, then with random values of
+// random magnitudes and signs, within +/- 2^62.
+void FillAccumulator(vector<long long>* accumulator) {
+  const long long kEdges[] = {
+    0, 1, -1, INT_MAX, -INT_MAX, INT_MIN, 2LL * INT_MAX, -2LL * INT_MAX,
+    40LL * INT_MAX, -40LL * INT_MAX, 41LL * INT_MAX, LLONG_MAX, LLONG_MIN,
+  };
+  accumulator->assign(kEdges, kEdges + sizeof(kEdges) / sizeof(kEdges[0]));
+  srand(1);
+  for (size_t sample = 0; sample < kRandomSampleCount; ++sample) {
+    long long value = (static_cast<long long>(rand()) << 31) ^ rand();
+    value >>= rand() % 62;
+    accumulator->push_back(rand() % 2 == 0 ? value : -value);
+  }
+}
+
+// Checks that the vectorized soft clip of 64 bit accumulators stays within one
+// unit of the reference curve, at every alignment and length of the tail left
+// to the scalar kernel.
+int main() {
+  vector<long long> accumulator;
+  FillAccumulator(&accumulator);
+  size_t sample_count = accumulator.size();
+  vector<int> reference(sample_count);
+  SoftClipSamples<int, long long>(&accumulator[0], sample_count,
+                                  &reference[0]);
+
+  vector<int> samples(sample_count);
+  size_t off_by_one_count = 0;
+  for (size_t offset = 0; offset < 8; ++offset) {
+    size_t count = sample_count - offset;
+    SoftClipSamples(&accumulator[offset], count, &samples[offset]);
+    for (size_t sample = offset; sample < sample_count; ++sample) {
+      long long error =
+          static_cast<long long>(samples[sample]) - reference[sample];
+      if (error < -1 || error > 1) {
+        fprintf(stderr, "Soft clip of %lld is %d, %d expected.\n",
+                accumulator[sample], samples[sample], reference[sample]);
+        return 1;
+      }
+      off_by_one_count += error != 0;
+    }
+  }
+  printf("%d samples within one unit of the reference, %.4f%% off by one.\n",
+         int(sample_count), 100.0 * off_by_one_count / (8 * sample_count));
+  return 0;
+}
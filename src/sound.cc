@@ -22,8 +22,15 @@ void ReadSamplesFromFile(SNDFILE* sound_file,
   sf_read_double(sound_file, samples, sample_count);
 }
 
+template < >
+void ReadSamplesFromFile(SNDFILE* sound_file,
+                         size_t sample_count,
+                         float* samples) {
+  sf_read_float(sound_file, samples, sample_count);
+}
+
 template <typename SampleType>
-void Sound::ReadFromFile(const string& path,
+int Sound::ReadFromFile(const string& path,
                          size_t* sample_frequency,
                          size_t* sample_count,
                          SampleType** samples) {
@@ -33,13 +40,20 @@ void Sound::ReadFromFile(const string& path,
 
   SF_INFO sound_file_info;
   SNDFILE* sound_file = sf_open(path.c_str(), SFM_READ, &sound_file_info);
+  if (sound_file == NULL) {
+    *sample_frequency = 0;
+    *sample_count = 0;
+    *samples = NULL;
+    return 0;
+  }
 
   *sample_frequency = sound_file_info.samplerate;
-  *sample_count = sound_file_info.frames;
+  *sample_count = sound_file_info.frames * sound_file_info.channels;
   *samples = new SampleType[*sample_count];
   ReadSamplesFromFile<SampleType>(sound_file, *sample_count, *samples);
 
   sf_close(sound_file);
+  return sound_file_info.channels;
 }
 
 template <typename SampleType>
@@ -119,5 +133,6 @@ void Sound::ReadFromMicrophone(double length,
 }
 
 // Explicit template instantiations for known valid types.
-template void Sound::ReadFromFile<double>(const string&, size_t*, size_t*, double**);
+template int Sound::ReadFromFile<double>(const string&, size_t*, size_t*, double**);
+template int Sound::ReadFromFile<float>(const string&, size_t*, size_t*, float**);
 template void Sound::ReadFromMicrophone<double>(double, size_t*, size_t*, double**);
@@ -6,9 +6,11 @@
 // A collection of routines for sound acquisition.
 class Sound {
 public:
-  // Allocates space for and reads samples from a file.
+  // Allocates space for and reads samples from a file, interleaved if it has
+  // several channels. Returns the number of channels, or 0 if the file cannot
+  // be opened, in which case no samples are read and 'samples' is NULL.
   template <typename SampleType>
-  static void ReadFromFile(const std::string& path,
+  static int ReadFromFile(const std::string& path,
                            size_t* sample_frequency,
                            size_t* sample_count,
                            SampleType** samples);
@@ -3,17 +3,73 @@
 #ifndef YYSTYPE_H_
 #define YYSTYPE_H_
 
+#include <stddef.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "segment.h"
+#include "segment_stream.h"
 
 typedef int SampleType;
 typedef long long AccumulatorType;
 
+// Parser stack entries are plain data, so shifts and reductions never allocate:
+// segments are held by the ParseState and referred to by index, and identifiers
+// point to names interned by it.
 struct yystype {
-  Segment<SampleType> segment;
+  int segment;              // Index into ParseState::segments.
   double value;
-  std::string text;
+  const std::string* text;  // Interned by ParseState::Intern().
 };
 
 #define YYSTYPE yystype
 
+// State of a single parse. The parser and lexer keep no global state, so any
+// number of scores may be parsed at once.
+struct ParseState {
+  explicit ParseState(SegmentConsumer<SampleType>* c)
+      : consumer(c), segment_count(0) {}
+
+  // Store a segment value, returning its index.
+  int AddSegment(const Segment<SampleType>& segment) {
+    if (segment_count == segments.size()) {
+      segments.push_back(segment);
+    } else {
+      segments[segment_count] = segment;
+    }
+    return static_cast<int>(segment_count++);
+  }
+
+  // Drop all segment values, keeping their storage for the next ones. Only
+  // valid once the parser stack refers to none of them.
+  void ClearSegments() {
+    for (size_t segment = 0; segment < segment_count; ++segment) {
+      segments[segment] = Segment<SampleType>();
+    }
+    segment_count = 0;
+  }
+
+  const std::string* Intern(const char* name) {
+    return &*names.insert(name).first;
+  }
+
+  SegmentConsumer<SampleType>* consumer;  // Receives the top-level segments.
+
+  // Segment values of the parser stack. Every top-level segment and definition
+  // leaves the stack without segments once reduced, so only the values of one
+  // of them are held at a time.
+  std::vector<Segment<SampleType> > segments;
+  size_t segment_count;  // Values in use, at the front of 'segments'.
+
+  std::set<std::string> names;  // Identifiers seen by the lexer.
+
+  // Segments bound to names by definitions. Each is an instance, so that every
+  // reference to it shares the same content.
+  std::map<std::string, Segment<SampleType> > named_segments;
+
+  std::string error;  // Describes the first error, if any.
+};
+
 #endif  // YYSTYPE_H_